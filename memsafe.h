@@ -9,13 +9,45 @@
 #include <stdexcept>
 #include <memory>
 
+#include <atomic>
 #include <mutex>
 #include <shared_mutex>
+#include <condition_variable>
 #include <thread>
+#include <future>
 #include <set>
+#include <map>
+#include <vector>
+#include <string>
+#include <source_location>
+#include <tuple>
+#include <coroutine>
+#include <stop_token>
+#include <chrono>
+#include <functional>
+#include <memory_resource>
+#include <new>
+#include <utility>
+#include <optional>
+#include <variant>
+#if __has_include(<expected>)
+#include <expected>
+#endif
+#include <array>
+#include <bit>
+#include <cstring>
+#include <algorithm>
 
 #include <format>
 
+#ifdef __linux__
+#include <linux/futex.h>
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <time.h>
+#endif
+
 #endif
 
 #ifdef BUILD_UNITTEST
@@ -25,6 +57,17 @@
 #define SCOPE(scope)  scope
 #endif   
 
+#if defined(BUILD_UNITTEST) && !defined(MEMSAFE_LOCK_STATS) && !defined(MEMSAFE_NO_LOCK_STATS)
+// Lock contention counters are tested in all translation units of the unit tests 
+// (MEMSAFE_NO_LOCK_STATS builds the unit tests of the disabled counters)
+#define MEMSAFE_LOCK_STATS
+#endif
+
+#if defined(BUILD_UNITTEST) && !defined(MEMSAFE_LOCK_TRACE) && !defined(MEMSAFE_NO_LOCK_TRACE)
+// The lock trace is compiled in the unit tests, but it is enabled at runtime only in its own test
+#define MEMSAFE_LOCK_TRACE
+#endif
+
 /**
  * @def SCOPE( scope )
  * 
@@ -203,6 +246,23 @@ namespace memsafe { // Begin define memory safety classes
 
     // Pre-definition of template class for variable with weak reference
     template <typename T> class Weak;
+    // Pre-definition of template class for lock-free shared data
+    template <typename V> class SyncAtomic;
+    // Pre-definition of template class for shared data with optimistic readers
+    template <typename V> class SyncSeqLock;
+    // Pre-definition of template class for shared data with immutable snapshots
+    template <typename V> class SyncRcu;
+    // Pre-definition of template class for data of only one thread
+    template <typename V> class SyncSingleThread;
+    // Pre-definition of template class for shared data with upgradable read lock
+    template <typename V> class SyncUpgradableShared;
+    // Pre-definition of template classes for shared data with timed mutexes
+    template <typename V> class SyncTimedMutex;
+    template <typename V> class SyncTimedShared;
+    // Pre-definition of template class for shared data with asynchronous lock of coroutines
+    template <typename V> class SyncAsyncMutex;
+    // Pre-definition of template class for shared data of an actor executing closures
+    template <typename V> class SyncExecutor;
 
     /*
      * Base class for shared data with the ability to multi-thread synchronize access
@@ -211,394 +271,4393 @@ namespace memsafe { // Begin define memory safety classes
     typedef std::chrono::milliseconds SyncTimeoutType;
     static constexpr SyncTimeoutType SyncTimeoutDeedlock = std::chrono::milliseconds(5000);
 
+    /**
+     * Error codes of the capture without exceptions (try_lock and try_lock_const)
+     */
+    enum class errc {
+        success = 0,
+        null_pointer,
+        timeout,
+        lock_order, // Lock order inversion reported by @ref LockOrder with the default handler
+        wrong_thread, // The data of @ref SyncSingleThread is captured by another thread
+        unsupported, // The timeout is not applicable for the policy without a synchronization object
+    };
+
+    /**
+     * Data of shared variable without multi-threaded access control.
+     * 
+     * This is the default policy of @ref Shared and the base class of all synchronization policies. 
+     * It contains no virtual methods and no additional fields, so the size of the object 
+     * is equal to the size of the data and locking methods are empty inline functions.
+     * 
+     * Synchronization policies (@ref SyncSingleThread, @ref SyncTimedMutex, @ref SyncTimedShared) 
+     * are resolved at compile time - @ref Locker and @ref Shared::make_auto call
+     * the methods of a specific policy type directly (see @ref SyncPolicy).
+     */
+
     template <typename V>
     class Sync {
     public:
 
         V data;
 
-        Sync(V v) : data(v), m_const_lock(false) {
+        Sync(const V & v) : data(v) {
+        }
+
+        Sync(V && v) : data(std::move(v)) {
+        }
+
+        /*
+         * In-place construction of the data from the constructor arguments of V (see @ref Shared::make)
+         */
+        template <typename ... Args>
+        explicit Sync(std::in_place_t, Args && ... args) : data(std::forward<Args>(args)...) {
         }
 
         [[nodiscard]]
-        bool TryLock(bool const_lock, const SyncTimeoutType &timeout = SyncTimeoutDeedlock) {
-            m_const_lock = const_lock;
-            return m_const_lock ? try_lock_const(timeout) : try_lock(timeout);
+        inline bool TryLock([[maybe_unused]] bool const_lock, const SyncTimeoutType &timeout = SyncTimeoutDeedlock) {
+            timeout_set_error(timeout);
+            return true;
         }
 
-        void UnLock() {
-            if (m_const_lock) {
-                unlock_const();
-            } else {
-                unlock();
-            }
+        inline void UnLock([[maybe_unused]] bool const_lock) {
+        }
+
+        inline void UnLockUnchanged([[maybe_unused]] bool const_lock) {
+        }
+
+        /*
+         * The error of the capture without exceptions instead of the exception of TryLock (see @ref Shared::try_lock)
+         */
+        inline errc TryLockError(const SyncTimeoutType &timeout) const {
+            return timeout != SyncTimeoutDeedlock ? errc::unsupported : errc::success;
         }
 
     protected:
-        bool m_const_lock;
 
         static void timeout_set_error(const SyncTimeoutType &timeout) {
             if (timeout != SyncTimeoutDeedlock) {
                 throw memsafe_error("Timeout is not applicable for this object type!");
             }
         }
+    };
+
+    /*
+     * The lock order of the policy D is tracked by @ref LockOrder: policies without a synchronization object 
+     * (Sync<V> and its wrappers with the same TryLock) and the data of only one thread cannot deadlock
+     */
+    template <typename V, typename D>
+    inline constexpr bool SyncLockOrdered = !std::is_same_v<decltype(&D::TryLock), decltype(&Sync<V>::TryLock)>
+            && !std::is_base_of_v<SyncSingleThread<V>, D>;
+
+    /**
+     * Runtime lock order graph for early deadlock detection (opt-in debug and canary mode).
+     * 
+     * Without it a deadlock shows up only as a try_lock timeout after @ref SyncTimeoutDeedlock.
+     * When enabled, every thread keeps a stack of the shared objects it holds, 
+     * and each acquisition of an object B while holding A adds an edge A -> B to the global graph.
+     * If B already precedes A in the graph (a cycle), the order inversion is reported 
+     * before blocking on the lock with the source locations of both acquisitions.
+     * 
+     * The graph is built from object addresses, the observed edges are kept until the shared data 
+     * is destroyed or clear() is called (an order taken once can close a cycle at any later time).
+     * Known edges are cached per thread, so the global mutex is only taken for a new lock order. 
+     * Checking can be sampled - enable(N) checks only every N-th nested acquisition of each thread. 
+     * When disabled, the cost is one relaxed atomic load per lock and one thread local read per unlock, 
+     * the policies without a synchronization object (see @ref SyncLockOrdered) are not tracked at all.
+     */
+
+    class LockOrder {
+    public:
+
+        typedef void (*HandlerType)(const std::string & message);
+
+        static void enable(uint32_t sampling = 1) {
+            m_sampling.store(sampling ? sampling : 1, std::memory_order_relaxed);
+        }
+
+        static void disable() {
+            m_sampling.store(0, std::memory_order_relaxed);
+        }
+
+        static bool enabled() {
+            return m_sampling.load(std::memory_order_relaxed);
+        }
+
+        /*
+         * By default the order inversion throws memsafe_error in the thread that closed the cycle, 
+         * the handler can only log it (for production canaries) and let the lock be acquired.
+         */
+        static void set_handler(HandlerType handler) {
+            m_handler.store(handler ? handler : &default_handler, std::memory_order_relaxed);
+        }
+
+        static void clear() {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            m_graph.clear();
+            m_edges.store(0, std::memory_order_relaxed);
+            m_generation.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        /*
+         * Returns false for the order inversion only with nothrow (the capture without exceptions) 
+         * and the default handler, a custom handler is called in both cases.
+         */
+        static inline bool check(const void * object, const std::source_location & location, bool nothrow = false) {
+            if (!enabled()) [[likely]] {
+                return true;
+            }
+            ThreadState & state = thread_state();
+            if (state.count && ++state.sample >= m_sampling.load(std::memory_order_relaxed)) {
+                state.sample = 0;
+                return check_edges(state, object, location, nothrow);
+            }
+            return true;
+        }
+
+        static inline void push(const void * object, const std::source_location & location) {
+            if (!enabled()) [[likely]] {
+                return;
+            }
+            ThreadState & state = thread_state();
+            if (state.count == state.capacity) [[unlikely]] {
+                grow(state);
+            }
+            state.held[state.count++] = {object, location.file_name(), location.line()};
+        }
+
+        static inline void release(const void * object) {
+            ThreadState & state = thread_state();
+            for (size_t pos = state.count; pos--;) {
+                if (state.held[pos].object == object) {
+                    std::copy(state.held + pos + 1, state.held + state.count, state.held + pos);
+                    state.count--;
+                    return;
+                }
+            }
+        }
+
+        static void forget(const void * object) {
+            if (m_edges.load(std::memory_order_relaxed)) {
+                std::lock_guard<std::mutex> guard(m_mutex);
+                size_t removed = 0;
+                auto found = m_graph.find(object);
+                if (found != m_graph.end()) {
+                    removed += found->second.size();
+                    m_graph.erase(found);
+                }
+                for (auto &node : m_graph) {
+                    removed += node.second.erase(object);
+                }
+                if (removed) {
+                    m_edges.fetch_sub(removed, std::memory_order_relaxed);
+                    m_generation.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        }
+
+    SCOPE(protected):
+
+        struct Site {
+            const void * object;
+            const char * file;
+            uint_least32_t line;
+        };
+
+        struct Edge {
+            Site from;
+            Site to;
+        };
+
+        // Trivial type without a constructor to access it without thread local initialization guard, 
+        // the stack of the held objects is moved to the heap when it does not fit into the inline array
+        struct ThreadState {
+            Site * held;
+            size_t count;
+            size_t capacity;
+            std::array<Site, 16> inline_held;
+            uint32_t sample;
+            uint32_t generation;
+            std::array<std::pair<const void *, const void *>, 64> cache;
+        };
+
+        static void default_handler(const std::string & message) {
+            throw memsafe_error(message);
+        }
+
+        static inline std::atomic<uint32_t> m_sampling = 0;
+        static inline std::atomic<uint32_t> m_generation = 1;
+        static inline std::atomic<size_t> m_edges = 0;
+        static inline std::atomic<HandlerType> m_handler = &default_handler;
+        static inline std::mutex m_mutex;
+        static inline std::map<const void *, std::map<const void *, Edge>> m_graph;
+
+        static ThreadState & thread_state() {
+            static thread_local ThreadState state;
+            return state;
+        }
+
+        static void grow(ThreadState & state) {
+            if (!state.held) {
+                state.held = state.inline_held.data();
+                state.capacity = state.inline_held.size();
+                return;
+            }
+            static thread_local std::unique_ptr<Site[]> storage;
+            std::unique_ptr<Site[]> held(new Site[state.capacity * 2]);
+            std::copy(state.held, state.held + state.count, held.get());
+            storage = std::move(held);
+            state.held = storage.get();
+            state.capacity *= 2;
+        }
+
+        static inline std::string site(const Site & site) {
+            return std::format("{}:{}", site.file, site.line);
+        }
+
+        static bool find_path(const void * from, const void * to, std::set<const void *> &visited, const Edge * &first) {
+            auto found = m_graph.find(from);
+            if (found == m_graph.end() || !visited.insert(from).second) {
+                return false;
+            }
+            for (auto &next : found->second) {
+                const Edge * unused = nullptr;
+                if (next.first == to || find_path(next.first, to, visited, unused)) {
+                    first = &next.second;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        static bool check_edges(ThreadState & state, const void * object, const std::source_location & location, bool nothrow) {
+            uint32_t generation = m_generation.load(std::memory_order_relaxed);
+            if (state.generation != generation) {
+                state.cache.fill({nullptr, nullptr});
+                state.generation = generation;
+            }
+
+            Site acquired{object, location.file_name(), location.line()};
+            for (size_t pos = 0; pos < state.count; pos++) {
+                const Site & held = state.held[pos];
+                if (held.object == object) {
+                    continue;
+                }
+                auto & cached = state.cache[(std::bit_cast<uintptr_t>(held.object) ^ (std::bit_cast<uintptr_t>(object) >> 4)) % state.cache.size()];
+                if (cached.first == held.object && cached.second == object) {
+                    continue;
+                }
+
+                std::string message;
+                {
+                    std::lock_guard<std::mutex> guard(m_mutex);
+                    std::set<const void *> visited;
+                    const Edge * reverse = nullptr;
+                    if (find_path(object, held.object, visited, reverse)) {
+                        message = std::format("Lock order inversion: acquired at {} while holding the lock acquired at {}, "
+                                "but the reverse order was taken at {} and then at {}",
+                                site(acquired), site(held), site(reverse->from), site(reverse->to));
+                    } else if (m_graph[held.object].emplace(object, Edge{held, acquired}).second) {
+                        m_edges.fetch_add(1, std::memory_order_relaxed);
+                    }
+                }
+                if (!message.empty()) {
+                    // The default handler throws and the inversion will be reported again on the next attempt
+                    HandlerType handler = m_handler.load(std::memory_order_relaxed);
+                    if (nothrow && handler == &default_handler) {
+                        return false;
+                    }
+                    handler(message);
+                }
+                cached = {held.object, object};
+            }
+            return true;
+        }
+    };
+
+#ifdef MEMSAFE_LOCK_STATS
+
+    /**
+     * Lock contention counters of the shared objects (opt-in, compiled only with MEMSAFE_LOCK_STATS).
+     * 
+     * For each shared object the acquisition count, wait time, hold time and timeout count are recorded 
+     * when acquiring in @ref Shared::make_auto, @ref lock_all and @ref Shared::lock_async and in the @ref Locker destructor. 
+     * The counters are written without locks to a table of the current thread, only its own thread writes to it, 
+     * snapshot() sums the tables of all threads (and of the finished threads) for each object.
+     * An object is labeled by the source location of its first acquisition in the thread.
+     * 
+     * When the shared data is destroyed, its slots are freed and its counters are summed per acquisition site 
+     * (the entries with a null object), so the memory of the counters does not grow with the number of objects.
+     * The objects that did not fit into the table of a thread are summed in the entry with a null object 
+     * and the site @ref overflow_site, its hold time is the time any of them was held.
+     * 
+     * The hold time is counted while the object is held by the thread at least once (nested read locks are not summed), 
+     * the hold time of the asynchronous locks is not counted (a coroutine can be resumed by another thread).
+     * The Locker layout does not depend on the macro, but it must be the same in all translation units.
+     * Destruction of a shared object takes the global mutex of the counters only if a slot could have been claimed for it 
+     * (the number of the claimed slots is counted per hash bucket without locks).
+     */
+
+    class LockStats {
+    public:
+
+        struct Counters {
+            uint64_t acquisitions = 0;
+            uint64_t timeouts = 0;
+            uint64_t wait_ns = 0;
+            uint64_t hold_ns = 0;
+
+            Counters & operator+=(const Counters & other) {
+                acquisitions += other.acquisitions;
+                timeouts += other.timeouts;
+                wait_ns += other.wait_ns;
+                hold_ns += other.hold_ns;
+                return *this;
+            }
+
+            Counters & operator-=(const Counters & other) {
+                acquisitions -= other.acquisitions;
+                timeouts -= other.timeouts;
+                wait_ns -= other.wait_ns;
+                hold_ns -= other.hold_ns;
+                return *this;
+            }
+        };
+
+        struct Entry {
+            const void * object; // Null for the destroyed objects of the site and for the overflow
+            const char * file;
+            uint_least32_t line;
+            Counters counters;
+        };
+
+        typedef std::vector<Entry> Snapshot;
+
+        static constexpr const char * overflow_site = "<overflow>";
+
+        static inline uint64_t now() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        static inline void acquired(const void * object, bool locked, uint64_t wait_start, const std::source_location & location, bool hold = true) {
+            const uint64_t time = now();
+            Slot & slot = find(object, location);
+            add(locked ? slot.acquisitions : slot.timeouts, 1);
+            add(slot.wait_ns, time - wait_start);
+            if (locked && hold && !slot.depth++) {
+                slot.held_since = time;
+            }
+        }
+
+        static inline void released(const void * object) {
+            Slot * slot = lookup(table(), object);
+            if (slot && slot->depth && !--slot->depth) {
+                add(slot->hold_ns, now() - slot->held_since);
+            }
+        }
+
+        /*
+         * Frees the slots of the destroyed object and moves its counters to the site of its first acquisition
+         */
+        static void forget(const void * object) {
+            // The claim of the slot happens before the destruction of the object by the release of its last reference
+            std::atomic<uint32_t> & bucket = claimed(object);
+            if (!bucket.load(std::memory_order_relaxed)) {
+                return;
+            }
+            std::lock_guard<std::mutex> guard(m_mutex);
+            Entry total{object, nullptr, 0,
+                {}};
+            bool found = false;
+            auto retired = m_retired.find(object);
+            if (retired != m_retired.end()) {
+                total = retired->second;
+                found = true;
+                m_retired.erase(retired);
+                bucket.fetch_sub(1, std::memory_order_relaxed);
+            }
+            for (ThreadTable * table : m_threads) {
+                // The owner thread does not write the slot of the destroyed object, it only claims the free slots
+                Slot * slot = lookup(*table, object);
+                if (slot && slot != &table->overflow) {
+                    if (!total.file) {
+                        total.file = slot->file.load(std::memory_order_relaxed);
+                        total.line = slot->line.load(std::memory_order_relaxed);
+                    }
+                    total.counters += slot->counters();
+                    slot->clear();
+                    slot->object.store(tombstone(), std::memory_order_release);
+                    bucket.fetch_sub(1, std::memory_order_relaxed);
+                    found = true;
+                }
+            }
+            if (found) {
+                const Site site{total.file, total.line};
+                m_destroyed[site] += total.counters;
+                auto base = m_baseline.find(object);
+                if (base != m_baseline.end()) {
+                    m_baseline_destroyed[site] += base->second;
+                    m_baseline.erase(base);
+                }
+            }
+        }
+
+        /*
+         * Counters of all objects since the last reset() ordered by the object address
+         */
+        static Snapshot snapshot() {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            Snapshot result;
+            auto append = [&result](Entry entry, const Counters * base) {
+                if (base) {
+                    entry.counters -= *base;
+                }
+                if (entry.counters.acquisitions || entry.counters.timeouts) {
+                    result.push_back(entry);
+                }
+            };
+            for (auto &item : total()) {
+                auto base = m_baseline.find(item.first);
+                append(item.second, base != m_baseline.end() ? &base->second : nullptr);
+            }
+            for (auto &item : m_destroyed) {
+                auto base = m_baseline_destroyed.find(item.first);
+                append(Entry{nullptr, item.first.first, item.first.second, item.second}, base != m_baseline_destroyed.end() ? &base->second : nullptr);
+            }
+            return result;
+        }
+
+        /*
+         * The counters are not cleared (the threads write them without locks), 
+         * the current values become the baseline of the next snapshots.
+         */
+        static void reset() {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            m_baseline.clear();
+            for (auto &item : total()) {
+                m_baseline[item.first] = item.second.counters;
+            }
+            m_baseline_destroyed = m_destroyed;
+        }
+
+        static void write_json(std::ostream & out, const Snapshot & snapshot) {
+            out << "[";
+            for (size_t pos = 0; pos < snapshot.size(); pos++) {
+                const Entry & entry = snapshot[pos];
+                out << std::format("{}\n{{\"object\":\"{}\",\"site\":\"{}:{}\",\"acquisitions\":{},\"timeouts\":{},\"wait_ns\":{},\"hold_ns\":{}}}",
+                        pos ? "," : "", entry.object, entry.file, entry.line, entry.counters.acquisitions,
+                        entry.counters.timeouts, entry.counters.wait_ns, entry.counters.hold_ns);
+            }
+            out << "\n]\n";
+        }
+
+        static void write_prometheus(std::ostream & out, const Snapshot & snapshot) {
+            static const std::array<std::pair<const char *, uint64_t Counters::*>, 4> metrics{
+                {
+                    {"memsafe_lock_acquisitions_total", &Counters::acquisitions},
+                    {"memsafe_lock_timeouts_total", &Counters::timeouts},
+                    {"memsafe_lock_wait_nanoseconds_total", &Counters::wait_ns},
+                    {"memsafe_lock_hold_nanoseconds_total", &Counters::hold_ns},
+                }
+            };
+            for (auto &metric : metrics) {
+                out << std::format("# TYPE {} counter\n", metric.first);
+                for (const Entry & entry : snapshot) {
+                    out << std::format("{}{{object=\"{}\",site=\"{}:{}\"}} {}\n",
+                            metric.first, entry.object, entry.file, entry.line, entry.counters.*metric.second);
+                }
+            }
+        }
+
+    SCOPE(protected):
+
+        struct Slot {
+            std::atomic<const void *> object;
+            std::atomic<const char *> file;
+            std::atomic<uint_least32_t> line;
+            std::atomic<uint64_t> acquisitions;
+            std::atomic<uint64_t> timeouts;
+            std::atomic<uint64_t> wait_ns;
+            std::atomic<uint64_t> hold_ns;
+            // Read and written only by the own thread
+            uint64_t held_since;
+            size_t depth;
+
+            Counters counters() const {
+                return {acquisitions.load(std::memory_order_relaxed), timeouts.load(std::memory_order_relaxed),
+                    wait_ns.load(std::memory_order_relaxed), hold_ns.load(std::memory_order_relaxed)};
+            }
+
+            void clear() {
+                acquisitions.store(0, std::memory_order_relaxed);
+                timeouts.store(0, std::memory_order_relaxed);
+                wait_ns.store(0, std::memory_order_relaxed);
+                hold_ns.store(0, std::memory_order_relaxed);
+            }
+        };
+
+        static constexpr size_t probes = 16;
+
+        struct ThreadTable {
+            std::array<Slot, 256> slots{};
+            Slot overflow{}; // Objects that did not fit into the table
+
+            ThreadTable() {
+                overflow.file.store(overflow_site, std::memory_order_relaxed);
+                std::lock_guard<std::mutex> guard(m_mutex);
+                m_threads.insert(this);
+            }
+
+            ~ThreadTable() {
+                std::lock_guard<std::mutex> guard(m_mutex);
+                for (const Slot & slot : slots) {
+                    // An object retired by another finished thread keeps a single claim
+                    const void * object = slot.object.load(std::memory_order_relaxed);
+                    if (object && object != tombstone() && m_retired.contains(object)) {
+                        claimed(object).fetch_sub(1, std::memory_order_relaxed);
+                    }
+                }
+                merge(m_retired, *this);
+                m_threads.erase(this);
+            }
+        };
+
+        typedef std::pair<const char *, uint_least32_t> Site;
+
+        static inline std::mutex m_mutex;
+        // Number of the claimed slots and of the retired objects per hash bucket
+        static inline std::array<std::atomic<uint32_t>, 1024> m_claimed{};
+        static inline std::set<ThreadTable *> m_threads;
+        // Counters of the live objects from the finished threads and of the destroyed objects per site
+        static inline std::map<const void *, Entry> m_retired;
+        static inline std::map<Site, Counters> m_destroyed;
+        static inline std::map<const void *, Counters> m_baseline;
+        static inline std::map<Site, Counters> m_baseline_destroyed;
+
+        static inline void add(std::atomic<uint64_t> &counter, uint64_t value) {
+            // Single writer - without the read-modify-write instruction
+            counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+        }
+
+        // The key of the slot freed by forget() until it is claimed by the own thread again
+        static inline const void * tombstone() {
+            static const char removed = 0;
+            return &removed;
+        }
+
+        static inline ThreadTable & table() {
+            static thread_local ThreadTable table;
+            return table;
+        }
+
+        static inline size_t hash(const void * object) {
+            return (std::bit_cast<uintptr_t>(object) >> 4) % std::tuple_size_v<decltype(ThreadTable::slots)>;
+        }
+
+        static inline std::atomic<uint32_t> & claimed(const void * object) {
+            return m_claimed[(std::bit_cast<uintptr_t>(object) >> 4) % m_claimed.size()];
+        }
+
+        /*
+         * The slot of the object, the overflow slot if the object could not be placed into the table 
+         * or nullptr if it was not recorded by the thread
+         */
+        static inline Slot * lookup(ThreadTable & table, const void * object) {
+            size_t pos = hash(object);
+            for (size_t probe = 0; probe < probes; probe++, pos = (pos + 1) % table.slots.size()) {
+                const void * key = table.slots[pos].object.load(std::memory_order_relaxed);
+                if (key == object) [[likely]] {
+                    return &table.slots[pos];
+                } else if (!key) {
+                    return nullptr;
+                }
+            }
+            return &table.overflow;
+        }
+
+        static inline Slot & find(const void * object, const std::source_location & location) {
+            ThreadTable & table = LockStats::table();
+            size_t pos = hash(object);
+            Slot * free = nullptr;
+            for (size_t probe = 0; probe < probes; probe++, pos = (pos + 1) % table.slots.size()) {
+                Slot & slot = table.slots[pos];
+                const void * key = slot.object.load(std::memory_order_relaxed);
+                if (key == object) [[likely]] {
+                    return slot;
+                } else if (!key || key == tombstone()) {
+                    if (!free) {
+                        free = &slot;
+                    }
+                    if (!key) {
+                        break;
+                    }
+                }
+            }
+            if (!free) {
+                return table.overflow;
+            }
+            // Synchronizes with clearing of the counters of the freed slot by forget()
+            free->object.load(std::memory_order_acquire);
+            free->file.store(location.file_name(), std::memory_order_relaxed);
+            free->line.store(location.line(), std::memory_order_relaxed);
+            free->depth = 0;
+            free->object.store(object, std::memory_order_release);
+            claimed(object).fetch_add(1, std::memory_order_relaxed);
+            return *free;
+        }
+
+        static void merge(std::map<const void *, Entry> &total, const ThreadTable & table) {
+            auto merge_slot = [&](const void * object, const Slot & slot) {
+                Entry & entry = total.try_emplace(object, Entry{object, slot.file.load(std::memory_order_relaxed), slot.line.load(std::memory_order_relaxed),
+                    {}}).first->second;
+                if (!entry.file || !*entry.file) {
+                    entry.file = slot.file.load(std::memory_order_relaxed);
+                    entry.line = slot.line.load(std::memory_order_relaxed);
+                }
+                entry.counters += slot.counters();
+            };
+            for (const Slot & slot : table.slots) {
+                const void * object = slot.object.load(std::memory_order_acquire);
+                if (object && object != tombstone()) {
+                    merge_slot(object, slot);
+                }
+            }
+            if (table.overflow.acquisitions.load(std::memory_order_relaxed) || table.overflow.timeouts.load(std::memory_order_relaxed)) {
+                merge_slot(nullptr, table.overflow);
+            }
+        }
+
+        // Guarded by m_mutex
+        static std::map<const void *, Entry> total() {
+            std::map<const void *, Entry> result = m_retired;
+            for (ThreadTable * table : m_threads) {
+                merge(result, *table);
+            }
+            return result;
+        }
+    };
+
+#endif
+
+#ifdef MEMSAFE_LOCK_TRACE
+
+    /**
+     * Trace of the lock acquisitions and releases in the Chrome trace event format 
+     * for chrome://tracing and Perfetto (opt-in, compiled only with MEMSAFE_LOCK_TRACE and enabled at runtime).
+     * 
+     * Each thread writes the events to its own ring buffer of @ref capacity events without locks, 
+     * the oldest events are overwritten. The timestamps are processor cycle counters 
+     * converted to microseconds only when writing the trace. write_chrome() pairs the acquisitions 
+     * with the releases of the same object and writes the complete events "wait" (a wait for the lock), 
+     * "hold" (the lifetime of the Locker) and "timeout" with the object address and the lock mode, 
+     * then the written events are removed from the buffers. The acquisitions that are not released yet 
+     * are kept until their release is written by one of the next calls.
+     * The events overwritten by their thread while the trace is written are skipped (each slot has a sequence number).
+     */
+
+    class LockTrace {
+    public:
+
+        static constexpr size_t capacity = 4096;
+
+        static void enable() {
+            m_ticks.store(now(), std::memory_order_relaxed);
+            m_nanoseconds.store(steady_ns(), std::memory_order_relaxed);
+            m_enabled.store(true, std::memory_order_relaxed);
+        }
+
+        static void disable() {
+            m_enabled.store(false, std::memory_order_relaxed);
+        }
+
+        static bool enabled() {
+            return m_enabled.load(std::memory_order_relaxed);
+        }
+
+        static inline uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__)
+            return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+            uint64_t ticks;
+            asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+            return ticks;
+#else
+            return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+        }
+
+        static inline void acquired(const void * object, bool const_lock, bool locked, uint64_t wait_start) {
+            if (enabled()) {
+                record(object, (locked ? Acquired : Timeout) | (const_lock ? static_cast<uint32_t> (Const) : 0u), wait_start, now());
+            }
+        }
+
+        static inline void released(const void * object, bool const_lock) {
+            if (enabled()) {
+                const uint64_t time = now();
+                record(object, Released | (const_lock ? static_cast<uint32_t> (Const) : 0u), time, time);
+            }
+        }
+
+        static void write_chrome(std::ostream & out) {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            calibrate();
+            std::vector<std::pair<uint32_t, Event>> events = std::move(m_retired);
+            m_retired.clear();
+            for (ThreadBuffer * buffer : m_threads) {
+                buffer->drain(events);
+            }
+
+            out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+            bool first = true;
+            auto complete = [&](const char * name, uint32_t thread, const Event & event, uint64_t start, uint64_t end) {
+                out << std::format("{}\n{{\"name\":\"{}\",\"cat\":\"memsafe\",\"ph\":\"X\",\"pid\":1,\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f},"
+                        "\"args\":{{\"object\":\"{}\",\"mode\":\"{}\"}}}}", first ? "" : ",", name, thread, micro(start), micro(end) - micro(start),
+                        event.object, event.kind & Const ? "const" : "exclusive");
+                first = false;
+            };
+
+            // Acquisitions held by each thread waiting for their release (also by the next call)
+            std::map<uint32_t, std::vector<Event>> &held = m_held;
+            for (auto &item : events) {
+                const Event & event = item.second;
+                switch (event.kind & ~Const) {
+                    case Acquired:
+                        complete("wait", item.first, event, event.start, event.end);
+                        held[item.first].push_back(event);
+                        break;
+                    case Timeout:
+                        complete("timeout", item.first, event, event.start, event.end);
+                        break;
+                    case Released:
+                    {
+                        auto &stack = held[item.first];
+                        for (size_t pos = stack.size(); pos--;) {
+                            if (stack[pos].object == event.object && stack[pos].kind == (Acquired | (event.kind & Const))) {
+                                complete("hold", item.first, stack[pos], stack[pos].end, event.end);
+                                stack.erase(stack.begin() + pos);
+                                break;
+                            }
+                        }
+                        break;
+                    }
+                }
+            }
+            // The locks of the finished threads will never be released
+            std::erase_if(held, [](const auto & item) {
+                return item.second.empty() || std::ranges::none_of(m_threads, [&item](ThreadBuffer * buffer) {
+                    return buffer->thread == item.first;
+                });
+            });
+            out << "\n]}\n";
+        }
+
+    SCOPE(protected):
+
+        enum : uint32_t {
+            Acquired = 0,
+            Timeout = 1,
+            Released = 2,
+            Const = 4,
+        };
+
+        struct Event {
+            const void * object;
+            uint32_t kind;
+            uint64_t start;
+            uint64_t end;
+        };
+
+        /*
+         * The sequence number is odd while the own thread writes the event at the position (sequence - 1) / 2 
+         * and even when it is written, so the drain skips the slots overwritten during the copy as with @ref SyncSeqLock
+         */
+        struct Slot {
+            std::atomic<size_t> sequence;
+            std::atomic<const void *> object;
+            std::atomic<uint32_t> kind;
+            std::atomic<uint64_t> start;
+            std::atomic<uint64_t> end;
+        };
+
+        struct ThreadBuffer {
+            std::unique_ptr<Slot[]> slots;
+            std::atomic<size_t> head = 0; // Written by the own thread only
+            size_t tail = 0; // Guarded by m_mutex
+            uint32_t thread;
+
+            ThreadBuffer() : slots(new Slot[capacity]()) {
+                std::lock_guard<std::mutex> guard(m_mutex);
+                thread = ++m_thread_count;
+                m_threads.insert(this);
+            }
+
+            ~ThreadBuffer() {
+                std::lock_guard<std::mutex> guard(m_mutex);
+                drain(m_retired);
+                m_threads.erase(this);
+            }
+
+            void drain(std::vector<std::pair<uint32_t, Event>> &events) {
+                const size_t end = head.load(std::memory_order_acquire);
+                for (size_t pos = std::max(tail, end > capacity ? end - capacity : 0); pos < end; pos++) {
+                    const Slot & slot = slots[pos % capacity];
+                    const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+                    if (sequence != 2 * pos + 2) { // The owner already writes a newer event to the slot
+                        continue;
+                    }
+                    const Event event{slot.object.load(std::memory_order_relaxed), slot.kind.load(std::memory_order_relaxed),
+                        slot.start.load(std::memory_order_relaxed), slot.end.load(std::memory_order_relaxed)};
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if (slot.sequence.load(std::memory_order_relaxed) == sequence) {
+                        events.emplace_back(thread, event);
+                    }
+                }
+                tail = end;
+            }
+        };
+
+        static inline std::atomic<bool> m_enabled = false;
+        static inline std::mutex m_mutex;
+        static inline std::set<ThreadBuffer *> m_threads;
+        static inline std::vector<std::pair<uint32_t, Event>> m_retired;
+        static inline std::map<uint32_t, std::vector<Event>> m_held;
+        static inline uint32_t m_thread_count = 0;
+
+        // Reference point of the cycle counter and the steady clock taken in enable() for conversion to microseconds
+        static inline std::atomic<uint64_t> m_ticks = 0;
+        static inline std::atomic<int64_t> m_nanoseconds = 0;
+        static inline double m_ticks_per_ns = 1; // Guarded by m_mutex
+
+        static inline void record(const void * object, uint32_t kind, uint64_t start, uint64_t end) {
+            static thread_local ThreadBuffer buffer;
+            const size_t pos = buffer.head.load(std::memory_order_relaxed);
+            Slot & slot = buffer.slots[pos % capacity];
+            slot.sequence.store(2 * pos + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            slot.object.store(object, std::memory_order_relaxed);
+            slot.kind.store(kind, std::memory_order_relaxed);
+            slot.start.store(start, std::memory_order_relaxed);
+            slot.end.store(end, std::memory_order_relaxed);
+            slot.sequence.store(2 * pos + 2, std::memory_order_release);
+            buffer.head.store(pos + 1, std::memory_order_release);
+        }
+
+        static inline int64_t steady_ns() {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        /*
+         * The frequency of the cycle counter is measured from enable() to the current time (at least 1 ms)
+         */
+        static void calibrate() {
+            const uint64_t ticks = m_ticks.load(std::memory_order_relaxed);
+            const int64_t nanoseconds = m_nanoseconds.load(std::memory_order_relaxed);
+            if (!ticks) {
+                return;
+            }
+            uint64_t ticks_now;
+            int64_t nanoseconds_now;
+            do {
+                ticks_now = now();
+                nanoseconds_now = steady_ns();
+            } while (nanoseconds_now - nanoseconds < 1'000'000);
+            m_ticks_per_ns = static_cast<double> (ticks_now - ticks) / (nanoseconds_now - nanoseconds);
+        }
+
+        static inline double micro(uint64_t ticks) {
+            return (m_nanoseconds.load(std::memory_order_relaxed)
+                    + static_cast<int64_t> (ticks - m_ticks.load(std::memory_order_relaxed)) / m_ticks_per_ns) / 1000.0;
+        }
+    };
+
+#endif
+
+    /**
+     * Base template class (CRTP) for synchronization policies.
+     * 
+     * Dispatches lock requests to the methods try_lock, unlock, try_lock_const and unlock_const 
+     * of the derived class P without virtual calls.
+     * 
+     * The lock mode (exclusive or read only) is not stored in the shared object, 
+     * it is carried by the type of @ref Locker, so concurrent readers do not write to the shared data.
+     */
+
+    template <typename V, typename P>
+    class SyncPolicy : public Sync<V> {
+    public:
+
+        template <typename ... Args>
+        SyncPolicy(Args && ... args) : Sync<V>(std::forward<Args>(args)...) {
+        }
+
+        ~SyncPolicy() {
+            LockOrder::forget(static_cast<const Sync<V> *> (this));
+#ifdef MEMSAFE_LOCK_STATS
+            LockStats::forget(static_cast<const Sync<V> *> (this));
+#endif
+        }
+
+        [[nodiscard]]
+        inline bool TryLock(bool const_lock, const SyncTimeoutType &timeout = SyncTimeoutDeedlock) {
+            return const_lock ? policy().try_lock_const(timeout) : policy().try_lock(timeout);
+        }
+
+        inline void UnLock(bool const_lock) {
+            if (const_lock) {
+                policy().unlock_const();
+            } else {
+                policy().unlock();
+            }
+        }
+
+        /*
+         * Release of the exclusive lock without any change of the data (the retry of @ref lock_all), 
+         * the policies acting on the release of the writer (@ref SyncRcu) can skip it with unlock_unchanged()
+         */
+        inline void UnLockUnchanged(bool const_lock) {
+            if constexpr (requires(P & p) {
+                    p.unlock_unchanged();
+                }) {
+                if (!const_lock) {
+                    policy().unlock_unchanged();
+                    return;
+                }
+            }
+            UnLock(const_lock);
+        }
+
+        // The policies with a synchronization object accept any timeout
+        inline errc TryLockError(const SyncTimeoutType &) const {
+            return errc::success;
+        }
+
+    protected:
+
+        inline P & policy() {
+            return static_cast<P &> (*this);
+        }
+    };
+
+    /**
+     * Temporary (auto) variable - owner of object reference (dereferences weak pointers 
+     * and increments ownership count of strong references).
+     * 
+     * Always contains only valid data (a valid reference and a captured synchronization object), 
+     * otherwise an exception will be thrown when attempting to create the object.
+     * 
+     * A helper template class wrapper for managing the lifetime 
+     * of captured variables and releasing their ownership in the destructor.   
+     * Similar to class and performs same functions as https://en.cppreference.com/w/cpp/thread/lock_guard
+     * 
+     * V - Variable value type
+     * T - The type of the specific captured variable
+     * const_lock - The synchronization object is captured for read only (shared) access
+     */
+
+    template <typename V, typename T, bool const_lock = false>
+    class Locker {
+    public:
+
+        Locker(T val) : value(std::forward<T>(val)) {
+        }
+
+        inline V& operator*() {
+            if constexpr (std::is_reference_v<T>) {
+                return value;
+            } else {
+                static_assert(std::is_base_of_v<Sync<V>, typename T::element_type>);
+                return value->data;
+            }
+        }
+
+        inline const V& operator*() const {
+            if constexpr (std::is_reference_v<T>) {
+                return value;
+            } else {
+                static_assert(std::is_base_of_v<Sync<V>, typename T::element_type>);
+                return value->data;
+            }
+        }
+
+        inline ~Locker() {
+            if constexpr (!std::is_reference_v<T>) {
+                static_assert(std::is_base_of_v<Sync<V>, typename T::element_type>);
+                value->UnLock(const_lock); // Non-virtual call of the specific synchronization policy
+                if constexpr (SyncLockOrdered<V, typename T::element_type>) {
+                    LockOrder::release(static_cast<const Sync<V> *> (value.get()));
+                }
+                if constexpr (!std::is_same_v<Sync<V>, typename T::element_type>) { // The Sync class is not counted (see Shared::acquire)
+#ifdef MEMSAFE_LOCK_STATS
+                    LockStats::released(static_cast<const Sync<V> *> (value.get()));
+#endif
+#ifdef MEMSAFE_LOCK_TRACE
+                    LockTrace::released(static_cast<const Sync<V> *> (value.get()), const_lock);
+#endif
+                }
+            }
+        }
+
+    private:
+        T value; // Type T can be a reference to data i.e. V& or a shared_ptr<S<V>> for policy S derived from Sync<V>
+
+        // Noncopyable
+        Locker(const Locker&) = delete;
+        Locker& operator=(const Locker&) = delete;
+        // Nonmovable
+        Locker(Locker&&) = delete;
+        Locker& operator=(Locker&&) = delete;
+    };
+
+    /**
+     * Temporary (auto) variable - owner of an immutable snapshot of the data (see @ref SyncRcu).
+     * 
+     * Holds a strong reference to the snapshot for its lifetime and allows read only access, 
+     * there is no synchronization object to be released in the destructor.
+     */
+
+    template <typename V>
+    class Locker<V, std::shared_ptr<const V>, true> {
+    public:
+
+        Locker(std::shared_ptr<const V> val) : value(std::move(val)) {
+        }
+
+        inline const V& operator*() const {
+            return *value;
+        }
+
+    private:
+        std::shared_ptr<const V> value;
+
+        // Noncopyable
+        Locker(const Locker&) = delete;
+        Locker& operator=(const Locker&) = delete;
+        // Nonmovable
+        Locker(Locker&&) = delete;
+        Locker& operator=(Locker&&) = delete;
+    };
+
+    /**
+     * Temporary (auto) variable - owner of the upgradable read lock (see @ref SyncUpgradableShared).
+     * 
+     * Allows read only access to the data and coexists with plain readers. 
+     * upgrade() returns an exclusive @ref Locker without releasing the lock, 
+     * when the exclusive Locker is destroyed, the lock returns to the upgradable mode.
+     * downgrade() turns it into a plain read lock to admit another upgradable owner.
+     * While the exclusive Locker of the upgrade is alive, upgrade() and downgrade() throw memsafe_error.
+     */
+
+    template <typename V, typename T>
+    class UpgradableLocker {
+    public:
+
+        UpgradableLocker(T val) : value(std::move(val)) {
+        }
+
+        inline const V& operator*() const {
+            return value->data;
+        }
+
+        Locker<V, T> upgrade(const SyncTimeoutType &timeout = SyncTimeoutDeedlock,
+                const std::source_location &location = std::source_location::current()) {
+            if (!upgradable) {
+                throw memsafe_error("Upgrade of the downgraded read lock");
+            }
+            if (value->Upgraded()) {
+                throw memsafe_error("The read lock is already upgraded");
+            }
+            // The upgrade waits for the readers, so it is checked and counted as a new exclusive acquisition
+            LockOrder::check(static_cast<const Sync<V> *> (value.get()), location);
+#ifdef MEMSAFE_LOCK_STATS
+            const uint64_t wait_start = LockStats::now();
+#endif
+#ifdef MEMSAFE_LOCK_TRACE
+            const uint64_t trace_start = LockTrace::enabled() ? LockTrace::now() : 0;
+#endif
+            const bool locked = value->TryUpgrade(timeout);
+#ifdef MEMSAFE_LOCK_STATS
+            LockStats::acquired(static_cast<const Sync<V> *> (value.get()), locked, wait_start, location);
+#endif
+#ifdef MEMSAFE_LOCK_TRACE
+            LockTrace::acquired(static_cast<const Sync<V> *> (value.get()), false, locked, trace_start);
+#endif
+            if (!locked) {
+                throw memsafe_error("try_upgrade timeout");
+            }
+            // The exclusive Locker releases its own entries of the lock order, the counters and the trace
+            LockOrder::push(static_cast<const Sync<V> *> (value.get()), location);
+            return Locker<V, T>(value);
+        }
+
+        void downgrade() {
+            if (upgradable) {
+                if (value->Upgraded()) {
+                    throw memsafe_error("Downgrade of the upgraded read lock");
+                }
+                value->DowngradeShared();
+                upgradable = false;
+            }
+        }
+
+        inline ~UpgradableLocker() {
+            if (upgradable) {
+                value->UnLockUpgradable();
+            } else {
+                value->UnLock(true);
+            }
+            LockOrder::release(static_cast<const Sync<V> *> (value.get()));
+#ifdef MEMSAFE_LOCK_STATS
+            LockStats::released(static_cast<const Sync<V> *> (value.get()));
+#endif
+#ifdef MEMSAFE_LOCK_TRACE
+            LockTrace::released(static_cast<const Sync<V> *> (value.get()), true);
+#endif
+        }
+
+    private:
+        T value;
+        bool upgradable = true;
+
+        // Noncopyable
+        UpgradableLocker(const UpgradableLocker&) = delete;
+        UpgradableLocker& operator=(const UpgradableLocker&) = delete;
+        // Nonmovable
+        UpgradableLocker(UpgradableLocker&&) = delete;
+        UpgradableLocker& operator=(UpgradableLocker&&) = delete;
+    };
+
+    /**
+     * Result of try_lock and try_lock_const - the captured @ref Locker or an error code.
+     * 
+     * The Locker is constructed in place, so the result does not allocate memory, 
+     * it releases the lock in the destructor as usual and cannot be moved.
+     * std::expected is a C++23 library feature, before it std::optional without the error code is used.
+     */
+#if defined(__cpp_lib_expected) && __cpp_lib_expected >= 202202L
+
+    template <typename L>
+    using TryLockResult = std::expected<L, errc>;
+
+    template <typename L>
+    inline TryLockResult<L> try_lock_error(errc error) {
+        return TryLockResult<L>(std::unexpect, error);
+    }
+#else
+
+    template <typename L>
+    using TryLockResult = std::optional<L>;
+
+    template <typename L>
+    inline TryLockResult<L> try_lock_error(errc) {
+        return std::nullopt;
+    }
+#endif
+
+    /**
+     * Variable by value without references.   
+     * A simple wrapper over data to unify access to it using class Auto
+     */
+    template <typename V>
+    class Value {
+    protected:
+        V value;
+    public:
+
+        Value(V val) : value(val) {
+        }
+
+        inline V& operator*() {
+            return value;
+        };
+
+        inline const V& operator*() const {
+            return value;
+        };
+
+        inline Locker<V, V&> lock() {
+            return Locker<V, V&> (value);
+        }
+
+        inline Locker<V, V&> lock() const {
+            return lock_const();
+        }
+
+        inline const Locker<V, V&> lock_const() const {
+            return Locker<V, V&> (value);
+        }
+    };
+
+    static_assert(std::is_standard_layout_v<Value<int>>);
+
+    /**
+     * Control block of the reference counter of @ref LocalShared without atomic operations
+     */
+    struct LocalControl {
+        size_t strong = 1;
+        size_t weak = 1; // Weak references plus one for all strong references
+        // The owner thread is checked by the weak references before the counters are changed
+        std::atomic<const void *> thread = current_thread();
+        void (*dispose)(LocalControl *) noexcept; // Destroys the data
+        void (*destroy)(LocalControl *) noexcept; // Releases the memory of the control block
+
+        /*
+         * The address of the thread-local variable is a token of the thread: 
+         * it is computed from the thread pointer register without calling std::this_thread::get_id()
+         */
+        static inline const void * current_thread() noexcept {
+            static thread_local const char token = 0;
+            return &token;
+        }
+    };
+
+    template <typename D, typename Alloc>
+    struct LocalBlock : public LocalControl {
+        [[no_unique_address]] Alloc alloc;
+        alignas(D) std::byte storage[sizeof (D)];
+
+        typedef typename std::allocator_traits<Alloc>::template rebind_alloc<LocalBlock<D, Alloc>> BlockAlloc;
+
+        LocalBlock(const Alloc & a) : alloc(a) {
+            dispose = [](LocalControl * control) noexcept {
+                static_cast<LocalBlock *> (control)->data()->~D();
+            };
+            destroy = [](LocalControl * control) noexcept {
+                LocalBlock * block = static_cast<LocalBlock *> (control);
+                BlockAlloc block_alloc(block->alloc);
+                block->~LocalBlock();
+                std::allocator_traits<BlockAlloc>::deallocate(block_alloc, block, 1);
+            };
+        }
+
+        inline D * data() noexcept {
+            return std::launder(reinterpret_cast<D *> (storage));
+        }
+    };
+
+    template <typename D> class LocalWeak;
+
+    /**
+     * Strong reference with a non-atomic reference counter for data of only one thread 
+     * (the base class of @ref Shared with the @ref SyncSingleThread policy instead of std::shared_ptr).
+     * 
+     * It has the same size and the same subset of the std::shared_ptr interface, 
+     * the control block and the data are placed in one allocation as with std::make_shared.
+     * Copies of the reference must not be created or destroyed in other threads.
+     */
+
+    template <typename D>
+    class LocalShared {
+    public:
+
+        typedef D element_type;
+
+        LocalShared() noexcept : m_data(nullptr), m_control(nullptr) {
+        }
+
+        LocalShared(std::nullptr_t) noexcept : LocalShared() {
+        }
+
+        LocalShared(const LocalShared & other) noexcept : m_data(other.m_data), m_control(other.m_control) {
+            if (m_control) {
+                m_control->strong++;
+            }
+        }
+
+        LocalShared(LocalShared && other) noexcept : m_data(std::exchange(other.m_data, nullptr)), m_control(std::exchange(other.m_control, nullptr)) {
+        }
+
+        LocalShared & operator=(const LocalShared & other) noexcept {
+            LocalShared(other).swap(*this);
+            return *this;
+        }
+
+        LocalShared & operator=(LocalShared && other) noexcept {
+            LocalShared(std::move(other)).swap(*this);
+            return *this;
+        }
+
+        ~LocalShared() {
+            if (m_control && !--m_control->strong) {
+                m_control->dispose(m_control);
+                if (!--m_control->weak) {
+                    m_control->destroy(m_control);
+                }
+            }
+        }
+
+        inline D * get() const noexcept {
+            return m_data;
+        }
+
+        inline D & operator*() const noexcept {
+            return *m_data;
+        }
+
+        inline D * operator->() const noexcept {
+            return m_data;
+        }
+
+        inline explicit operator bool() const noexcept {
+            return m_data;
+        }
+
+        inline long use_count() const noexcept {
+            return m_control ? m_control->strong : 0;
+        }
+
+        // The only strong reference without weak references
+        inline bool unique() const noexcept {
+            return m_control && m_control->strong == 1 && m_control->weak == 1;
+        }
+
+        inline void transfer_to_current_thread() noexcept {
+            if (m_control) {
+                m_control->thread.store(LocalControl::current_thread(), std::memory_order_relaxed);
+            }
+        }
+
+        inline void reset() noexcept {
+            LocalShared().swap(*this);
+        }
+
+        inline void swap(LocalShared & other) noexcept {
+            std::swap(m_data, other.m_data);
+            std::swap(m_control, other.m_control);
+        }
+
+        template <typename Alloc, typename ... Args>
+        static LocalShared allocate(const Alloc & alloc, Args && ... args) {
+            typedef LocalBlock<D, Alloc> Block;
+            typename Block::BlockAlloc block_alloc(alloc);
+            Block * block = std::allocator_traits<typename Block::BlockAlloc>::allocate(block_alloc, 1);
+            ::new (block) Block(alloc);
+            try {
+                ::new (block->storage) D(std::forward<Args>(args)...);
+            } catch (...) {
+                block->~Block();
+                std::allocator_traits<typename Block::BlockAlloc>::deallocate(block_alloc, block, 1);
+                throw;
+            }
+            return LocalShared(block->data(), block);
+        }
+
+        template <typename ... Args>
+        static LocalShared make(Args && ... args) {
+            return allocate(std::allocator<D>(), std::forward<Args>(args)...);
+        }
+
+    protected:
+        friend class LocalWeak<D>;
+
+        D * m_data;
+        LocalControl * m_control;
+
+        LocalShared(D * data, LocalControl * control) noexcept : m_data(data), m_control(control) {
+        }
+    };
+
+    /**
+     * Weak reference to @ref LocalShared with the same subset of the std::weak_ptr interface
+     */
+
+    template <typename D>
+    class LocalWeak {
+    public:
+
+        LocalWeak() noexcept : m_data(nullptr), m_control(nullptr) {
+        }
+
+        LocalWeak(const LocalShared<D> & shared) noexcept : m_data(shared.m_data), m_control(shared.m_control) {
+            if (m_control) {
+                m_control->weak++;
+            }
+        }
+
+        LocalWeak(const LocalWeak & other) noexcept : m_data(other.m_data), m_control(other.m_control) {
+            if (m_control) {
+                m_control->weak++;
+            }
+        }
+
+        LocalWeak & operator=(const LocalWeak & other) noexcept {
+            LocalWeak(other).swap(*this);
+            return *this;
+        }
+
+        ~LocalWeak() {
+            if (m_control && !--m_control->weak) {
+                m_control->destroy(m_control);
+            }
+        }
+
+        inline LocalShared<D> lock() const noexcept {
+            if (expired()) {
+                return LocalShared<D>();
+            }
+            m_control->strong++;
+            return LocalShared<D>(m_data, m_control);
+        }
+
+        inline bool expired() const noexcept {
+            return !m_control || !m_control->strong;
+        }
+
+        // The counters may be changed only by the owner thread of the data
+        inline bool owned_by_current_thread() const noexcept {
+            return !m_control || m_control->thread.load(std::memory_order_relaxed) == LocalControl::current_thread();
+        }
+
+        inline long use_count() const noexcept {
+            return m_control ? m_control->strong : 0;
+        }
+
+        inline void reset() noexcept {
+            LocalWeak().swap(*this);
+        }
+
+        inline void swap(LocalWeak & other) noexcept {
+            std::swap(m_data, other.m_data);
+            std::swap(m_control, other.m_control);
+        }
+
+    protected:
+        D * m_data;
+        LocalControl * m_control;
+    };
+
+    /*
+     * Types of strong and weak references to the shared data of the policy: 
+     * std::shared_ptr for multi-threaded data and a non-atomic reference counter for @ref SyncSingleThread
+     */
+
+    template <typename D>
+    struct SharedPointer {
+        typedef std::shared_ptr<D> SharedType;
+        typedef std::weak_ptr<D> WeakType;
+
+        static constexpr bool allocator_aware = true;
+
+        template <typename ... Args>
+        static inline SharedType make(Args && ... args) {
+            return std::make_shared<D>(std::forward<Args>(args)...);
+        }
+
+        template <typename Alloc, typename ... Args>
+        static inline SharedType allocate(const Alloc & alloc, Args && ... args) {
+            return std::allocate_shared<D>(alloc, std::forward<Args>(args)...);
+        }
+    };
+
+    // The type of the data may be incomplete here (a field of the same class), so only the exact policy is matched
+    template <typename V>
+    struct SharedPointer<SyncSingleThread<V>> {
+        typedef LocalShared<SyncSingleThread<V>> SharedType;
+        typedef LocalWeak<SyncSingleThread<V>> WeakType;
+
+        static constexpr bool allocator_aware = true;
+
+        template <typename ... Args>
+        static inline SharedType make(Args && ... args) {
+            return SharedType::make(std::forward<Args>(args)...);
+        }
+
+        template <typename Alloc, typename ... Args>
+        static inline SharedType allocate(const Alloc & alloc, Args && ... args) {
+            return SharedType::allocate(alloc, std::forward<Args>(args)...);
+        }
+    };
+
+    /**
+     * Tag policy of the shared data with intrusive reference counters: `Shared<V, Intrusive<SyncTimedMutex>::Policy>`.
+     * 
+     * The strong and weak counters are placed in the same block directly before the data of the policy S 
+     * (without the virtual table and the deleter of the std::shared_ptr control block), 
+     * strong and weak references are a single pointer (see @ref IntrusiveShared).
+     * The block is allocated by operator new, Shared::allocate with an allocator is not available.
+     */
+
+    template <template <typename> typename S, typename V>
+    class IntrusivePolicy : public S<V> {
+    public:
+
+        template <typename ... Args>
+        IntrusivePolicy(Args && ... args) : S<V>(std::forward<Args>(args)...) {
+        }
+    };
+
+    template <template <typename> typename S>
+    struct Intrusive {
+        template <typename V>
+        using Policy = IntrusivePolicy<S, V>;
+    };
+
+    template <typename D>
+    struct IntrusiveBlock {
+        std::atomic<uint32_t> strong = 1;
+        std::atomic<uint32_t> weak = 1; // Weak references plus one for all strong references
+
+        union {
+            D data; // Destroyed with the last strong reference, the block is released with the last weak reference
+        };
+
+        IntrusiveBlock() {
+        }
+
+        ~IntrusiveBlock() {
+        }
+    };
+
+    template <typename D> class IntrusiveWeak;
+
+    /**
+     * Strong reference of a single pointer to the block with intrusive reference counters (see @ref Intrusive)
+     */
+
+    template <typename D>
+    class IntrusiveShared {
+    public:
+
+        typedef D element_type;
+
+        IntrusiveShared() noexcept : m_block(nullptr) {
+        }
+
+        IntrusiveShared(std::nullptr_t) noexcept : IntrusiveShared() {
+        }
+
+        IntrusiveShared(const IntrusiveShared & other) noexcept : m_block(other.m_block) {
+            if (m_block) {
+                m_block->strong.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        IntrusiveShared(IntrusiveShared && other) noexcept : m_block(std::exchange(other.m_block, nullptr)) {
+        }
+
+        IntrusiveShared & operator=(const IntrusiveShared & other) noexcept {
+            IntrusiveShared(other).swap(*this);
+            return *this;
+        }
+
+        IntrusiveShared & operator=(IntrusiveShared && other) noexcept {
+            IntrusiveShared(std::move(other)).swap(*this);
+            return *this;
+        }
+
+        ~IntrusiveShared() {
+            if (m_block && m_block->strong.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                m_block->data.~D();
+                IntrusiveWeak<D>::release(m_block);
+            }
+        }
+
+        inline D * get() const noexcept {
+            return m_block ? &m_block->data : nullptr;
+        }
+
+        inline D & operator*() const noexcept {
+            return m_block->data;
+        }
+
+        inline D * operator->() const noexcept {
+            return &m_block->data;
+        }
+
+        inline explicit operator bool() const noexcept {
+            return m_block;
+        }
+
+        inline long use_count() const noexcept {
+            return m_block ? m_block->strong.load(std::memory_order_relaxed) : 0;
+        }
+
+        inline void reset() noexcept {
+            IntrusiveShared().swap(*this);
+        }
+
+        inline void swap(IntrusiveShared & other) noexcept {
+            std::swap(m_block, other.m_block);
+        }
+
+        template <typename ... Args>
+        static IntrusiveShared make(Args && ... args) {
+            IntrusiveBlock<D> * block = new IntrusiveBlock<D>();
+            try {
+                ::new (&block->data) D(std::forward<Args>(args)...);
+            } catch (...) {
+                delete block;
+                throw;
+            }
+            return IntrusiveShared(block);
+        }
+
+    protected:
+        friend class IntrusiveWeak<D>;
+
+        IntrusiveBlock<D> * m_block;
+
+        explicit IntrusiveShared(IntrusiveBlock<D> * block) noexcept : m_block(block) {
+        }
+    };
+
+    /**
+     * Weak reference of a single pointer to the block with intrusive reference counters (see @ref Intrusive)
+     */
+
+    template <typename D>
+    class IntrusiveWeak {
+    public:
+
+        IntrusiveWeak() noexcept : m_block(nullptr) {
+        }
+
+        IntrusiveWeak(const IntrusiveShared<D> & shared) noexcept : m_block(shared.m_block) {
+            if (m_block) {
+                m_block->weak.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        IntrusiveWeak(const IntrusiveWeak & other) noexcept : m_block(other.m_block) {
+            if (m_block) {
+                m_block->weak.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        IntrusiveWeak & operator=(const IntrusiveWeak & other) noexcept {
+            IntrusiveWeak(other).swap(*this);
+            return *this;
+        }
+
+        ~IntrusiveWeak() {
+            if (m_block) {
+                release(m_block);
+            }
+        }
+
+        inline IntrusiveShared<D> lock() const noexcept {
+            if (m_block) {
+                // The strong reference is taken only while the data is alive
+                uint32_t strong = m_block->strong.load(std::memory_order_relaxed);
+                while (strong) {
+                    if (m_block->strong.compare_exchange_weak(strong, strong + 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+                        return IntrusiveShared<D>(m_block);
+                    }
+                }
+            }
+            return IntrusiveShared<D>();
+        }
+
+        inline bool expired() const noexcept {
+            return !m_block || !m_block->strong.load(std::memory_order_relaxed);
+        }
+
+        inline long use_count() const noexcept {
+            return m_block ? m_block->strong.load(std::memory_order_relaxed) : 0;
+        }
+
+        inline void reset() noexcept {
+            IntrusiveWeak().swap(*this);
+        }
+
+        inline void swap(IntrusiveWeak & other) noexcept {
+            std::swap(m_block, other.m_block);
+        }
+
+    protected:
+        friend class IntrusiveShared<D>;
+
+        IntrusiveBlock<D> * m_block;
+
+        static inline void release(IntrusiveBlock<D> * block) noexcept {
+            if (block->weak.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                delete block;
+            }
+        }
+    };
+
+    template <template <typename> typename S, typename V>
+    struct SharedPointer<IntrusivePolicy<S, V>> {
+        typedef IntrusiveShared<IntrusivePolicy<S, V>> SharedType;
+        typedef IntrusiveWeak<IntrusivePolicy<S, V>> WeakType;
+
+        // The block keeps only the counters before the data without a deleter or the allocator
+        static constexpr bool allocator_aware = false;
+
+        template <typename ... Args>
+        static inline SharedType make(Args && ... args) {
+            return SharedType::make(std::forward<Args>(args)...);
+        }
+    };
+
+    /**
+     * Condition variables of the shared objects for @ref Shared::wait_until and @ref Shared::notify_one.
+     * 
+     * The policies do not store a condition variable (the size of the shared data does not change), 
+     * objects are hashed to a fixed table of std::condition_variable_any that releases the lock 
+     * of the policy atomically while waiting. If waiters of different objects share the bucket, 
+     * notify_one wakes all of them and each rechecks its predicate.
+     */
+
+    class SyncWaitTable {
+    public:
+
+        template <typename L, typename P>
+        static bool wait_until(const void * object, L & lock, const std::chrono::steady_clock::time_point & deadline, P && pred) {
+            Bucket & bucket = get(object);
+            {
+                std::lock_guard<std::mutex> guard(bucket.mutex);
+                bucket.waiters[object]++;
+            }
+            struct Leave {
+                Bucket & bucket;
+                const void * object;
+
+                ~Leave() {
+                    std::lock_guard<std::mutex> guard(bucket.mutex);
+                    if (!--bucket.waiters[object]) {
+                        bucket.waiters.erase(object);
+                    }
+                }
+            } leave{bucket, object};
+            return bucket.condition.wait_until(lock, deadline, std::forward<P>(pred));
+        }
+
+        static void notify_one(const void * object) {
+            Bucket & bucket = get(object);
+            std::lock_guard<std::mutex> guard(bucket.mutex);
+            if (bucket.waiters.size() == 1) {
+                bucket.condition.notify_one();
+            } else if (!bucket.waiters.empty()) {
+                bucket.condition.notify_all();
+            }
+        }
+
+        static void notify_all(const void * object) {
+            Bucket & bucket = get(object);
+            std::lock_guard<std::mutex> guard(bucket.mutex);
+            if (!bucket.waiters.empty()) {
+                bucket.condition.notify_all();
+            }
+        }
+
+    SCOPE(protected):
+
+        struct Bucket {
+            std::mutex mutex;
+            std::condition_variable_any condition;
+            std::map<const void *, size_t> waiters; // Objects waited in the bucket and the number of their waiters
+        };
+
+        static Bucket & get(const void * object) {
+            static std::array<Bucket, 64> table;
+            return table[(std::bit_cast<uintptr_t>(object) >> 4) % table.size()];
+        }
+    };
+
+    /**
+     * Waiter in the queue of @ref SyncAsyncMutex - a suspended coroutine or a blocked thread.
+     * 
+     * The state is changed only under the mutex of the policy, the coroutine is resumed 
+     * by the thread that changed the state from Queued (inline or by posting it to the executor).
+     */
+
+    struct AsyncWaiter {
+
+        enum State : uint8_t {
+            Idle,
+            Queued,
+            Granted,
+            Timeout,
+            Cancelled,
+        };
+
+        AsyncWaiter * prev = nullptr;
+        AsyncWaiter * next = nullptr;
+        bool const_lock = false;
+        State state = Idle;
+        std::coroutine_handle<> handle; // Empty for a blocked thread
+        void * executor = nullptr;
+        void (*post)(void * executor, std::coroutine_handle<> handle) = nullptr;
+
+        inline void resume() {
+            if (post) {
+                post(executor, handle);
+            } else {
+                handle.resume();
+            }
+        }
+    };
+
+    /**
+     * Worker thread resuming the timed out and cancelled coroutines without an executor (see @ref Shared::lock_async),
+     * so that the coroutine does not run on the timer thread or on the thread calling request_stop().
+     * 
+     * It is started at the first such resumption, the coroutines still queued at the program exit are not resumed.
+     */
+
+    class AsyncResumer {
+    public:
+
+        static void post(std::coroutine_handle<> handle) {
+            instance().push(handle);
+        }
+
+        ~AsyncResumer() {
+            {
+                std::lock_guard<std::mutex> guard(m_mutex);
+                m_stop = true;
+            }
+            m_condition.notify_all();
+            m_thread.join();
+        }
+
+    SCOPE(protected):
+        friend class AsyncTimer;
+
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+        std::vector<std::coroutine_handle<>> m_queue;
+        bool m_stop = false;
+        std::thread m_thread; // Started after the other fields are initialized
+
+        AsyncResumer() : m_thread([this]() {
+            run();
+        }) {
+        }
+
+        static AsyncResumer & instance() {
+            static AsyncResumer resumer;
+            return resumer;
+        }
+
+        void push(std::coroutine_handle<> handle) {
+            {
+                std::lock_guard<std::mutex> guard(m_mutex);
+                m_queue.push_back(handle);
+            }
+            m_condition.notify_all();
+        }
+
+        void run() {
+            std::vector<std::coroutine_handle<>> ready;
+            std::unique_lock<std::mutex> guard(m_mutex);
+            while (!m_stop) {
+                if (m_queue.empty()) {
+                    m_condition.wait(guard);
+                } else {
+                    ready.swap(m_queue);
+                    guard.unlock();
+                    for (auto handle : ready) {
+                        handle.resume();
+                    }
+                    ready.clear();
+                    guard.lock();
+                }
+            }
+        }
+    };
+
+    /**
+     * Timer thread for the timeouts of the suspended coroutines (see @ref Shared::lock_async).
+     * 
+     * It is started at the first asynchronous lock. An entry fired by the timer can be removed 
+     * from any thread, the removal waits until the firing of the entry is finished.
+     */
+
+    class AsyncTimer {
+    public:
+
+        struct Entry {
+            std::chrono::steady_clock::time_point deadline;
+            void (*fire)(void * arg);
+            void * arg;
+        };
+
+        static void add(Entry & entry) {
+            instance().insert(entry);
+        }
+
+        static void remove(Entry & entry) {
+            instance().erase(entry);
+        }
+
+        ~AsyncTimer() {
+            {
+                std::lock_guard<std::mutex> guard(m_mutex);
+                m_stop = true;
+            }
+            m_condition.notify_all();
+            m_thread.join();
+        }
+
+    SCOPE(protected):
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+        std::multimap<std::chrono::steady_clock::time_point, Entry *> m_entries;
+        Entry * m_firing = nullptr;
+        bool m_stop = false;
+        std::thread m_thread; // Started after the other fields are initialized
+
+        AsyncTimer() : m_thread([this]() {
+            run();
+        }) {
+            AsyncResumer::instance(); // Constructed first, so it outlives the timer firing into it
+        }
+
+        static AsyncTimer & instance() {
+            static AsyncTimer timer;
+            return timer;
+        }
+
+        void insert(Entry & entry) {
+            {
+                std::lock_guard<std::mutex> guard(m_mutex);
+                m_entries.emplace(entry.deadline, &entry);
+            }
+            m_condition.notify_all();
+        }
+
+        void erase(Entry & entry) {
+            std::unique_lock<std::mutex> guard(m_mutex);
+            auto range = m_entries.equal_range(entry.deadline);
+            for (auto iter = range.first; iter != range.second; ++iter) {
+                if (iter->second == &entry) {
+                    m_entries.erase(iter);
+                    return;
+                }
+            }
+            if (std::this_thread::get_id() != m_thread.get_id()) {
+                m_condition.wait(guard, [&]() {
+                    return m_firing != &entry;
+                });
+            }
+        }
+
+        void run() {
+            std::unique_lock<std::mutex> guard(m_mutex);
+            while (!m_stop) {
+                if (m_entries.empty()) {
+                    m_condition.wait(guard);
+                } else if (const auto deadline = m_entries.begin()->first; deadline > std::chrono::steady_clock::now()) {
+                    m_condition.wait_until(guard, deadline); // The entry can be removed while waiting
+                } else {
+                    m_firing = m_entries.begin()->second;
+                    m_entries.erase(m_entries.begin());
+                    guard.unlock();
+                    m_firing->fire(m_firing->arg); // The entry can be destroyed by the resumed coroutine
+                    guard.lock();
+                    m_firing = nullptr;
+                    m_condition.notify_all();
+                }
+            }
+        }
+    };
+
+    /**
+     * Awaitable of the asynchronous lock (see @ref Shared::lock_async) - co_await returns the @ref Locker.
+     * 
+     * If the lock is busy, the coroutine is queued in the policy and resumed when the lock is granted to it 
+     * on release by another owner, so the thread is not blocked. On timeout or cancellation 
+     * by the std::stop_token the coroutine is resumed and co_await throws memsafe_error.
+     * 
+     * With an executor all resumptions (grant, timeout and cancellation) are posted to it. 
+     * WITHOUT AN EXECUTOR A GRANTED COROUTINE IS RESUMED INLINE BY THE THREAD RELEASING THE LOCK, 
+     * a timed out or cancelled one is posted to the shared worker thread of @ref AsyncResumer 
+     * (neither the timer thread nor the thread calling request_stop() runs the coroutine). 
+     * Coroutines that must not run on these threads have to pass an executor.
+     */
+
+    template <typename V, typename T, bool read_only>
+    class LockAwaiter {
+    public:
+
+        LockAwaiter(T shared, const SyncTimeoutType &timeout, std::stop_token stop, void * executor,
+                void (*post)(void *, std::coroutine_handle<>), const std::source_location &location)
+        : shared(std::move(shared)), timeout(timeout), stop(std::move(stop)), location(location) {
+            node.const_lock = read_only;
+            node.executor = executor;
+            node.post = post;
+        }
+
+        ~LockAwaiter() {
+            // The coroutine frame is destroyed without resumption
+            if (node.state == AsyncWaiter::Queued) {
+                shared->CancelAsync(node, AsyncWaiter::Cancelled);
+            }
+            if (timed) {
+                AsyncTimer::remove(entry);
+            }
+        }
+
+        bool await_ready() {
+            if (!shared) {
+                return true;
+            }
+#ifdef MEMSAFE_LOCK_STATS
+            wait_start = LockStats::now();
+#endif
+            if (shared->TryLockNow(read_only)) {
+                node.state = AsyncWaiter::Granted;
+                return true;
+            }
+            return false;
+        }
+
+        bool await_suspend(std::coroutine_handle<> handle) {
+            node.handle = handle;
+            // The timer and the stop callback are registered before queuing, 
+            // because the queued coroutine can be resumed by another thread immediately
+            entry = {std::chrono::steady_clock::now() + timeout, &fire, this};
+            AsyncTimer::add(entry);
+            timed = true;
+            if (stop.stop_possible()) {
+                callback.emplace(stop, Cancel{this});
+            }
+            return shared->EnqueueAsync(node);
+        }
+
+        Locker<V, T, read_only> await_resume() {
+            if (timed) {
+                AsyncTimer::remove(entry);
+                timed = false;
+            }
+            callback.reset();
+            if (!shared) {
+                throw memsafe_error("Object missing (null pointer exception)");
+            }
+#ifdef MEMSAFE_LOCK_STATS
+            // The hold time is not counted, the coroutine can be resumed and release the lock in another thread
+            if (node.state != AsyncWaiter::Cancelled) {
+                LockStats::acquired(static_cast<const Sync<V> *> (shared.get()), node.state == AsyncWaiter::Granted, wait_start, location, false);
+            }
+#endif
+            if (node.state == AsyncWaiter::Timeout) {
+                throw memsafe_error(std::format("lock{}_async timeout", read_only ? "_const" : ""));
+            } else if (node.state == AsyncWaiter::Cancelled) {
+                throw memsafe_error(std::format("lock{}_async cancelled", read_only ? "_const" : ""));
+            }
+            return Locker<V, T, read_only>(std::move(shared));
+        }
+
+    private:
+
+        struct Cancel {
+            LockAwaiter * awaiter;
+
+            void operator()() {
+                awaiter->cancel(AsyncWaiter::Cancelled);
+            }
+        };
+
+        T shared;
+        SyncTimeoutType timeout;
+        std::stop_token stop;
+        std::source_location location;
+        uint64_t wait_start = 0;
+        AsyncWaiter node;
+        AsyncTimer::Entry entry;
+        bool timed = false;
+        std::optional<std::stop_callback<Cancel>> callback;
+
+        static void fire(void * arg) {
+            static_cast<LockAwaiter *> (arg)->cancel(AsyncWaiter::Timeout);
+        }
+
+        void cancel(AsyncWaiter::State state) {
+            if (shared->CancelAsync(node, state)) {
+                if (node.post) {
+                    node.resume();
+                } else {
+                    AsyncResumer::post(node.handle);
+                }
+            }
+        }
+
+        // Noncopyable
+        LockAwaiter(const LockAwaiter&) = delete;
+        LockAwaiter& operator=(const LockAwaiter&) = delete;
+        // Nonmovable
+        LockAwaiter(LockAwaiter&&) = delete;
+        LockAwaiter& operator=(LockAwaiter&&) = delete;
+    };
+
+    /**
+     * Reference variable (shared pointer) with optional multi-threaded access control.
+     * 
+     * By default using template @ref Sync without multithreaded access control.
+     * @see @ref SyncSingleThread, @ref SyncTimedMutex, @ref SyncTimedShared  )
+     * 
+     */
+
+    template <typename V, template <typename> typename S = Sync>
+    class Shared : public SharedPointer< S<V> >::SharedType {
+    public:
+
+        typedef V ValueType;
+        typedef S<V> DataType;
+        typedef typename SharedPointer<DataType>::WeakType WeakType;
+        typedef typename SharedPointer<DataType>::SharedType SharedType;
+
+        Shared() : SharedType(nullptr) {
+        }
+
+        Shared(const V & val) : SharedType(SharedPointer<DataType>::make(val)) {
+        }
+
+        Shared(V && val) : SharedType(SharedPointer<DataType>::make(std::move(val))) {
+        }
+
+        /*
+         * The data is constructed in place from the arguments of the constructor of V without copying
+         */
+        template <typename ... Args>
+        explicit Shared(std::in_place_t, Args && ... args) : SharedType(SharedPointer<DataType>::make(std::in_place, std::forward<Args>(args)...)) {
+        }
+
+        template <typename ... Args>
+        static Shared<V, S> make(Args && ... args) {
+            return Shared<V, S>(std::in_place, std::forward<Args>(args)...);
+        }
+
+        /*
+         * The control block and the data are allocated by the allocator (std::allocate_shared), 
+         * for example from a request arena of std::pmr::monotonic_buffer_resource, 
+         * so the memory of all variables is released at once together with the arena.
+         * All shared and weak references must be destroyed before the memory resource.
+         * Not available for the intrusive reference counters (see @ref Intrusive).
+         */
+        template <typename Alloc, typename ... Args>
+        Shared(std::allocator_arg_t, const Alloc & alloc, Args && ... args) requires (SharedPointer<DataType>::allocator_aware)
+        : SharedType(SharedPointer<DataType>::allocate(alloc, std::in_place, std::forward<Args>(args)...)) {
+        }
+
+        template <typename Alloc, typename ... Args>
+        static Shared<V, S> allocate(const Alloc & alloc, Args && ... args)
+        requires (SharedPointer<DataType>::allocator_aware && !std::is_convertible_v<Alloc, std::pmr::memory_resource *>) {
+            return Shared<V, S>(std::allocator_arg, alloc, std::forward<Args>(args)...);
+        }
+
+        template <typename ... Args>
+        static Shared<V, S> allocate(std::pmr::memory_resource * resource, Args && ... args)
+        requires (SharedPointer<DataType>::allocator_aware) {
+            return Shared<V, S>(std::allocator_arg, std::pmr::polymorphic_allocator<DataType>(resource), std::forward<Args>(args)...);
+        }
+
+        Shared(const Shared<V, S> &val) = default;
+        Shared<V, S> & operator=(const Shared<V, S> &val) = default;
+        Shared(Shared<V, S> &&val) = default;
+        Shared<V, S> & operator=(Shared<V, S> &&val) = default;
+
+        template <bool read_only = false>
+        static auto make_auto(const SharedType * shared, const SyncTimeoutType &timeout = SyncTimeoutDeedlock,
+                const std::source_location &location = std::source_location::current()) {
+            if constexpr (read_only && std::is_base_of_v<SyncRcu<V>, DataType>) { // Readers only pin the snapshot without lock
+                return Locker<V, typename DataType::SnapshotType, true> (get_data(shared).snapshot());
+            } else {
+                errc result = acquire<read_only>(shared, timeout, location);
+                if (result != errc::success) [[unlikely]] {
+                    throw_error<read_only>(result);
+                }
+                return Locker<V, SharedType, read_only> (*shared);
+            }
+        }
+
+        /*
+         * The strong reference just promoted from a weak pointer is moved to the Locker without copying
+         */
+        template <bool read_only = false>
+        static auto make_auto(SharedType && shared, const SyncTimeoutType &timeout = SyncTimeoutDeedlock,
+                const std::source_location &location = std::source_location::current()) {
+            if constexpr (read_only && std::is_base_of_v<SyncRcu<V>, DataType>) {
+                return make_auto<read_only>(&shared, timeout, location);
+            } else {
+                errc result = acquire<read_only>(&shared, timeout, location);
+                if (result != errc::success) [[unlikely]] {
+                    throw_error<read_only>(result);
+                }
+                return Locker<V, SharedType, read_only> (std::move(shared));
+            }
+        }
+
+        /*
+         * Capture without exceptions on timeout and null pointer (see @ref TryLockResult)
+         */
+        template <bool read_only = false>
+        static auto make_try(const SharedType * shared, const SyncTimeoutType &timeout = SyncTimeoutDeedlock,
+                const std::source_location &location = std::source_location::current()) {
+            typedef decltype(make_auto<read_only>(shared, timeout, location)) LockerType;
+            if constexpr (read_only && std::is_base_of_v<SyncRcu<V>, DataType>) {
+                if (!shared || !shared->get()) {
+                    return try_lock_error<LockerType>(errc::null_pointer);
+                }
+                return TryLockResult<LockerType>(std::in_place, shared->get()->snapshot());
+            } else {
+                errc result = acquire<read_only, true>(shared, timeout, location);
+                if (result != errc::success) {
+                    return try_lock_error<LockerType>(result);
+                }
+                return TryLockResult<LockerType>(std::in_place, *shared);
+            }
+        }
+
+        template <bool read_only = false>
+        static auto make_try(SharedType && shared, const SyncTimeoutType &timeout = SyncTimeoutDeedlock,
+                const std::source_location &location = std::source_location::current()) {
+            if constexpr (read_only && std::is_base_of_v<SyncRcu<V>, DataType>) {
+                return make_try<read_only>(&shared, timeout, location);
+            } else {
+                typedef decltype(make_auto<read_only>(&shared, timeout, location)) LockerType;
+                errc result = acquire<read_only, true>(&shared, timeout, location);
+                if (result != errc::success) {
+                    return try_lock_error<LockerType>(result);
+                }
+                return TryLockResult<LockerType>(std::in_place, std::move(shared));
+            }
+        }
+
+        Locker<V, SharedType> lock(const SyncTimeoutType &timeout = SyncTimeoutDeedlock,
+                const std::source_location &location = std::source_location::current()) {
+            return make_auto<false>(this, timeout, location);
+        }
+
+        TryLockResult<Locker<V, SharedType>> try_lock(const SyncTimeoutType &timeout = SyncTimeoutDeedlock,
+                const std::source_location &location = std::source_location::current()) {
+            return make_try<false>(this, timeout, location);
+        }
+
+        auto try_lock_const(const SyncTimeoutType &timeout = SyncTimeoutDeedlock,
+                const std::source_location &location = std::source_location::current()) const {
+            return make_try<true>(this, timeout, location);
+        }
+
+        auto lock_const(const SyncTimeoutType &timeout = SyncTimeoutDeedlock,
+                const std::source_location &location = std::source_location::current()) const {
+            return make_auto<true>(this, timeout, location);
+        }
+
+        /*
+         * Read lock that can be upgraded to exclusive without releasing (see @ref UpgradableLocker)
+         */
+        static UpgradableLocker<V, SharedType> make_upgradable(const SharedType * shared, const SyncTimeoutType &timeout,
+                const std::source_location &location) requires std::is_base_of_v<SyncUpgradableShared<V>, DataType> {
+            if (!shared || !shared->get()) {
+                throw memsafe_error("Object missing (null pointer exception)");
+            }
+            LockOrder::check(static_cast<const Sync<V> *> (shared->get()), location);
+#ifdef MEMSAFE_LOCK_STATS
+            const uint64_t wait_start = LockStats::now();
+#endif
+#ifdef MEMSAFE_LOCK_TRACE
+            const uint64_t trace_start = LockTrace::enabled() ? LockTrace::now() : 0;
+#endif
+            // Counted and traced as a read lock the same way as in acquire()
+            const bool locked = shared->get()->TryLockUpgradable(timeout);
+#ifdef MEMSAFE_LOCK_STATS
+            LockStats::acquired(static_cast<const Sync<V> *> (shared->get()), locked, wait_start, location);
+#endif
+#ifdef MEMSAFE_LOCK_TRACE
+            LockTrace::acquired(static_cast<const Sync<V> *> (shared->get()), true, locked, trace_start);
+#endif
+            if (!locked) {
+                throw memsafe_error("try_lock upgradable timeout");
+            }
+            LockOrder::push(static_cast<const Sync<V> *> (shared->get()), location);
+            return UpgradableLocker<V, SharedType>(*shared);
+        }
+
+        UpgradableLocker<V, SharedType> lock_upgradable(const SyncTimeoutType &timeout = SyncTimeoutDeedlock,
+                const std::source_location &location = std::source_location::current()) const
+        requires std::is_base_of_v<SyncUpgradableShared<V>, DataType> {
+            return make_upgradable(this, timeout, location);
+        }
+
+        /**
+         * Asynchronous lock for coroutines with @ref SyncAsyncMutex policy: 
+         * auto guard = co_await shared.lock_async(); returns the same Locker as lock() 
+         * without blocking the thread while waiting (see @ref LockAwaiter).
+         * 
+         * The coroutine is resumed in the thread that released the lock, or it is posted 
+         * to the executor with the method post(std::coroutine_handle<>). 
+         * On timeout or when a stop is requested by the stop token, co_await throws memsafe_error, 
+         * without the executor the coroutine is then resumed by the worker thread of @ref AsyncResumer.
+         */
+        inline LockAwaiter<V, SharedType, false> lock_async(const SyncTimeoutType &timeout = SyncTimeoutDeedlock,
+                std::stop_token stop = {}, const std::source_location &location = std::source_location::current()) const
+        requires std::is_base_of_v<SyncAsyncMutex<V>, DataType> {
+            return LockAwaiter<V, SharedType, false>(*this, timeout, std::move(stop), nullptr, nullptr, location);
+        }
+
+        inline LockAwaiter<V, SharedType, true> lock_const_async(const SyncTimeoutType &timeout = SyncTimeoutDeedlock,
+                std::stop_token stop = {}, const std::source_location &location = std::source_location::current()) const
+        requires std::is_base_of_v<SyncAsyncMutex<V>, DataType> {
+            return LockAwaiter<V, SharedType, true>(*this, timeout, std::move(stop), nullptr, nullptr, location);
+        }
+
+        template <typename E>
+        inline LockAwaiter<V, SharedType, false> lock_async(E & executor, const SyncTimeoutType &timeout = SyncTimeoutDeedlock,
+                std::stop_token stop = {}, const std::source_location &location = std::source_location::current()) const
+        requires std::is_base_of_v<SyncAsyncMutex<V>, DataType>
+        && requires(E & e, std::coroutine_handle<> handle) {
+            e.post(handle);
+        } {
+            return LockAwaiter<V, SharedType, false>(*this, timeout, std::move(stop), &executor, &post_to<E>, location);
+        }
+
+        template <typename E>
+        inline LockAwaiter<V, SharedType, true> lock_const_async(E & executor, const SyncTimeoutType &timeout = SyncTimeoutDeedlock,
+                std::stop_token stop = {}, const std::source_location &location = std::source_location::current()) const
+        requires std::is_base_of_v<SyncAsyncMutex<V>, DataType>
+        && requires(E & e, std::coroutine_handle<> handle) {
+            e.post(handle);
+        } {
+            return LockAwaiter<V, SharedType, true>(*this, timeout, std::move(stop), &executor, &post_to<E>, location);
+        }
+
+        /**
+         * Execution of fn(V &) by the actor with @ref SyncExecutor policy (one closure at a time), 
+         * returns std::future with the result of fn or its exception.
+         */
+        template <typename F>
+        inline std::future<std::invoke_result_t<F, V &>> submit(F && fn) const
+        requires std::is_base_of_v<SyncExecutor<V>, DataType> {
+            return get_data(this).Submit(std::forward<F>(fn));
+        }
+
+        /**
+         * Waiting for the predicate pred(const V &) on the data without busy polling.
+         * 
+         * The predicate is checked under the exclusive lock, while waiting the lock is released 
+         * atomically as with std::condition_variable_any, the other threads wake the waiters 
+         * with notify_one() or notify_all() after changing the data. 
+         * Returns the exclusive Locker with the satisfied predicate, 
+         * the timeout limits the lock acquisition, the waiting and taking the lock again after a notification.
+         */
+        template <typename P>
+        Locker<V, SharedType> wait_until(P pred, const SyncTimeoutType &timeout = SyncTimeoutDeedlock,
+                const std::source_location &location = std::source_location::current())
+        requires (std::is_base_of_v<SyncTimedMutex<V>, DataType> || std::is_base_of_v<SyncTimedShared<V>, DataType>) {
+            const auto deadline = std::chrono::steady_clock::now() + timeout;
+            errc result = acquire<false>(this, timeout, location);
+            if (result != errc::success) {
+                throw_error<false>(result);
+            }
+
+            struct Adopted { // Releases the lock acquired above by the Locker destructor on timeout or exception
+                const SharedType * shared;
+
+                ~Adopted() {
+                    if (shared) {
+                        Locker<V, SharedType> unlock(*shared);
+                    }
+                }
+            } adopted{this};
+
+            /*
+             * BasicLockable for std::condition_variable_any. While waiting the object stays in the held locks 
+             * of LockOrder (the thread does not acquire anything else), but it is not counted as held by LockStats and LockTrace.
+             * The lock is taken again within the remaining time, after the deadline it is tried once 
+             * and the failure is returned to wait_until in the flag locked instead of an exception from the condition variable.
+             */
+            struct WaitLock {
+                DataType & data;
+                const std::chrono::steady_clock::time_point deadline;
+                const std::source_location &location;
+                bool locked = true;
+
+                void lock() {
+#ifdef MEMSAFE_LOCK_STATS
+                    const uint64_t wait_start = LockStats::now();
+#endif
+#ifdef MEMSAFE_LOCK_TRACE
+                    const uint64_t trace_start = LockTrace::enabled() ? LockTrace::now() : 0;
+#endif
+                    const auto remaining = std::chrono::ceil<SyncTimeoutType>(deadline - std::chrono::steady_clock::now());
+                    locked = data.TryLock(false, std::max(remaining, SyncTimeoutType(0)));
+#ifdef MEMSAFE_LOCK_STATS
+                    LockStats::acquired(static_cast<const Sync<V> *> (&data), locked, wait_start, location);
+#endif
+#ifdef MEMSAFE_LOCK_TRACE
+                    LockTrace::acquired(static_cast<const Sync<V> *> (&data), false, locked, trace_start);
+#endif
+                }
+
+                void unlock() {
+                    data.UnLock(false);
+#ifdef MEMSAFE_LOCK_STATS
+                    LockStats::released(static_cast<const Sync<V> *> (&data));
+#endif
+#ifdef MEMSAFE_LOCK_TRACE
+                    LockTrace::released(static_cast<const Sync<V> *> (&data), false);
+#endif
+                }
+            } wait_lock{*this->get(), deadline, location};
+
+            const V & value = this->get()->data;
+            const bool satisfied = SyncWaitTable::wait_until(static_cast<const Sync<V> *> (this->get()), wait_lock, deadline, [&]() {
+                return !wait_lock.locked || pred(value);
+            });
+            if (!wait_lock.locked) {
+                adopted.shared = nullptr; // Not taken again after the deadline
+                if constexpr (SyncLockOrdered<V, DataType>) {
+                    LockOrder::release(static_cast<const Sync<V> *> (this->get()));
+                }
+                throw memsafe_error("wait_until timeout");
+            } else if (!satisfied) {
+                throw memsafe_error("wait_until timeout");
+            }
+            adopted.shared = nullptr;
+            return Locker<V, SharedType>(*this);
+        }
+
+        inline void notify_one() const
+        requires (std::is_base_of_v<SyncTimedMutex<V>, DataType> || std::is_base_of_v<SyncTimedShared<V>, DataType>) {
+            SyncWaitTable::notify_one(static_cast<const Sync<V> *> (this->get()));
+        }
+
+        inline void notify_all() const
+        requires (std::is_base_of_v<SyncTimedMutex<V>, DataType> || std::is_base_of_v<SyncTimedShared<V>, DataType>) {
+            SyncWaitTable::notify_all(static_cast<const Sync<V> *> (this->get()));
+        }
+
+        /**
+         * Hand-off of the single thread variable to the current thread (see @ref SyncSingleThread::transfer_to_current_thread).
+         * 
+         * The non-atomic reference counter of @ref LocalShared would be changed by both threads 
+         * if a copy of the reference remained in the previous thread (in a queue item or in the producer), 
+         * so the transferred variable must be the only strong reference without weak references, 
+         * otherwise memsafe_error is thrown. Move the variable between the stages instead of copying it.
+         */
+        inline void transfer_to_current_thread() const
+        requires std::is_base_of_v<SyncSingleThread<V>, DataType> {
+            if (this->get()) {
+                if constexpr (std::is_same_v<SharedType, LocalShared<DataType>>) {
+                    if (!this->unique()) {
+                        throw memsafe_error("Transfer of a single thread variable with other references!");
+                    }
+                    const_cast<Shared *> (this)->SharedType::transfer_to_current_thread();
+                }
+                this->get()->transfer_to_current_thread();
+            }
+        }
+
+//        template < typename = std::enable_if<std::is_trivially_copyable_v < V >> >
+        inline V & operator*() const {
+            if constexpr (std::is_same_v<Sync<V>, DataType>) {
+                // Without access control the temporary Locker only copies the strong reference, 
+                // which is released before the returned reference is used anyway
+                return get_data(this).data;
+            } else {
+                auto guard_lock = lock_const();
+                return *guard_lock;
+            }
+        }
+
+//        template < typename = std::enable_if<std::is_trivially_copyable_v < V >> >
+        inline SharedType & operator=(V && value) {
+            auto guard_lock = lock();
+            *guard_lock = std::move(value);
+            return *this;
+        }
+
+        inline SharedType & set(V && value, const SyncTimeoutType &timeout = SyncTimeoutDeedlock) {
+            auto guard_lock = lock(timeout);
+            *guard_lock = std::move(value);
+            return *this;
+        }
+        
+        //        template < typename = std::enable_if<std::is_trivially_copyable_v < V >> >
+        //        inline SharedType & operator=(SharedType & s) {
+        //            auto guard_lock = lock_const();
+        //            return this->memsafe::shared_ptr<S < V>>::operator*().data;
+        //        }
+        //
+
+        inline Weak<Shared < V, S >> weak() {
+            return Weak<Shared < V, S >> (*this);
+        }
+
+        static DataType & get_data(const SharedType * shared) {
+            if (!shared || !shared->get()) {
+                throw memsafe_error("Object missing (null pointer exception)");
+            }
+            return *shared->get();
+        }
+
+    SCOPE(protected) :
+
+        /*
+         * With nothrow (the capture without exceptions) the lock order inversion is returned as errc::lock_order
+         */
+        template <bool read_only, bool nothrow = false>
+        static inline errc acquire(const SharedType * shared, const SyncTimeoutType &timeout, const std::source_location &location) {
+            static_assert(!std::is_base_of_v<SyncExecutor<V>, DataType>, "The data of SyncExecutor policy is accessed only by submit()");
+            if constexpr (!std::is_same_v<Sync<V>, DataType>) { // The Sync class has no access control
+                if (!shared || !shared->get()) {
+                    return errc::null_pointer;
+                }
+                if constexpr (nothrow) { // The errors that TryLock of the policy would throw
+                    if (errc error = shared->get()->TryLockError(timeout); error != errc::success) [[unlikely]] {
+                        return error;
+                    }
+                }
+                if constexpr (SyncLockOrdered<V, DataType>) { // Only one thread cannot deadlock
+                    if (!LockOrder::check(static_cast<const Sync<V> *> (shared->get()), location, nothrow)) {
+                        return errc::lock_order;
+                    }
+                }
+#ifdef MEMSAFE_LOCK_STATS
+                const uint64_t wait_start = LockStats::now();
+#endif
+#ifdef MEMSAFE_LOCK_TRACE
+                const uint64_t trace_start = LockTrace::enabled() ? LockTrace::now() : 0;
+#endif
+                const bool locked = shared->get()->TryLock(read_only, timeout);
+#ifdef MEMSAFE_LOCK_STATS
+                LockStats::acquired(static_cast<const Sync<V> *> (shared->get()), locked, wait_start, location);
+#endif
+#ifdef MEMSAFE_LOCK_TRACE
+                LockTrace::acquired(static_cast<const Sync<V> *> (shared->get()), read_only, locked, trace_start);
+#endif
+                if (!locked) {
+                    return errc::timeout;
+                }
+                if constexpr (SyncLockOrdered<V, DataType>) {
+                    LockOrder::push(static_cast<const Sync<V> *> (shared->get()), location);
+                }
+            }
+            return errc::success;
+        }
+
+        template <typename E>
+        static void post_to(void * executor, std::coroutine_handle<> handle) {
+            static_cast<E *> (executor)->post(handle);
+        }
+
+        template <bool read_only>
+        [[noreturn]] static void throw_error(errc error) {
+            if (error == errc::null_pointer) {
+                throw memsafe_error("Object missing (null pointer exception)");
+            } else if (error == errc::lock_order) {
+                throw memsafe_error("Lock order inversion");
+            }
+            throw memsafe_error(std::format("try_lock{} timeout", read_only ? " read only" : ""));
+        }
+
+    public:
+
+        /*
+         * Lock-free access to data of the shared variable with @ref SyncAtomic policy
+         */
+
+        inline V load(std::memory_order order = std::memory_order_seq_cst) const requires std::is_base_of_v<SyncAtomic<V>, DataType> {
+            return get_data(this).atomic().load(order);
+        }
+
+        /*
+         * Optimistic copy of data of the shared variable with @ref SyncSeqLock policy
+         */
+
+        inline V load() const requires std::is_base_of_v<SyncSeqLock<V>, DataType> {
+            return get_data(this).load();
+        }
+
+        /*
+         * Copy of the value under one read lock. Unlike operator* (returns the reference after the lock is released), 
+         * the caller gets its own copy and does not need to lock the data again for each access.
+         */
+
+        static constexpr bool is_lock_free = std::is_base_of_v<SyncAtomic<V>, DataType> || std::is_base_of_v<SyncSeqLock<V>, DataType>;
+
+        inline V load(const SyncTimeoutType &timeout = SyncTimeoutDeedlock,
+                const std::source_location &location = std::source_location::current()) const requires (!is_lock_free) {
+            auto guard_lock = lock_const(timeout, location);
+            return *guard_lock;
+        }
+
+        /*
+         * Calls func(const V &) under one read lock and returns its result by value
+         * (for atomic and sequence lock policies func gets a consistent copy of the data)
+         */
+
+        template <typename F>
+        inline auto visit(F && func, const SyncTimeoutType &timeout = SyncTimeoutDeedlock,
+                const std::source_location &location = std::source_location::current()) const -> std::decay_t<std::invoke_result_t<F, const V &>> {
+            if constexpr (is_lock_free) {
+                const V value = load();
+                return std::invoke(std::forward<F>(func), value);
+            } else {
+                auto guard_lock = lock_const(timeout, location);
+                return std::invoke(std::forward<F>(func), *guard_lock);
+            }
+        }
+
+        /*
+         * Batched read of several fields (pointers to data members or getters) in one acquisition, 
+         * for example `auto [count, sum] = stat.load(&Stat::count, &Stat::sum);`
+         */
+
+        template <typename ... M>
+        inline auto load(M ... fields) const requires (sizeof...(M) > 0 && (std::is_member_pointer_v<M> && ...)) {
+            return visit([&](const V & value) {
+                return std::make_tuple(std::invoke(fields, value)...);
+            });
+        }
+
+        inline void store(V value, std::memory_order order = std::memory_order_seq_cst) const requires std::is_base_of_v<SyncAtomic<V>, DataType> {
+            get_data(this).atomic().store(value, order);
+        }
+
+        inline V exchange(V value, std::memory_order order = std::memory_order_seq_cst) const requires std::is_base_of_v<SyncAtomic<V>, DataType> {
+            return get_data(this).atomic().exchange(value, order);
+        }
+
+        inline bool compare_exchange(V & expected, V desired, std::memory_order order = std::memory_order_seq_cst) const requires std::is_base_of_v<SyncAtomic<V>, DataType> {
+            return get_data(this).atomic().compare_exchange_strong(expected, desired, order);
+        }
+
+        inline V fetch_add(V arg, std::memory_order order = std::memory_order_seq_cst) const requires std::is_base_of_v<SyncAtomic<V>, DataType> {
+            return get_data(this).atomic().fetch_add(arg, order);
+        }
+
+        inline V fetch_sub(V arg, std::memory_order order = std::memory_order_seq_cst) const requires std::is_base_of_v<SyncAtomic<V>, DataType> {
+            return get_data(this).atomic().fetch_sub(arg, order);
+        }
+
+        inline V fetch_and(V arg, std::memory_order order = std::memory_order_seq_cst) const requires std::is_base_of_v<SyncAtomic<V>, DataType> {
+            return get_data(this).atomic().fetch_and(arg, order);
+        }
+
+        inline V fetch_or(V arg, std::memory_order order = std::memory_order_seq_cst) const requires std::is_base_of_v<SyncAtomic<V>, DataType> {
+            return get_data(this).atomic().fetch_or(arg, order);
+        }
+
+        inline V fetch_xor(V arg, std::memory_order order = std::memory_order_seq_cst) const requires std::is_base_of_v<SyncAtomic<V>, DataType> {
+            return get_data(this).atomic().fetch_xor(arg, order);
+        }
+
+        inline explicit operator bool() const noexcept {
+            return this->get();
+        }
+    };
+
+    /**
+     * A wrapper template class for storing weak pointers to shared variables
+     */
+
+    template <typename A>
+    struct LockAllTraits;
+
+    template <typename T>
+    class Weak : public T::WeakType {
+        friend struct LockAllTraits<Weak<T>>;
+    public:
+
+        Weak() : T::WeakType() {
+        }
+
+        Weak(const T ptr) : T::WeakType(ptr) {
+        }
+
+        Weak(const Weak & old) = default;
+        Weak & operator=(const Weak & old) = default;
+
+        template <bool read_only = false>
+        auto make_auto(const SyncTimeoutType &timeout = SyncTimeoutDeedlock,
+                const std::source_location &location = std::source_location::current()) const {
+            // The weak pointer is promoted once and the strong reference is moved to the Locker
+            return T::template make_auto<read_only>(promote(), timeout, location);
+        }
+
+        inline Locker<typename T::ValueType, typename T::SharedType> lock(const SyncTimeoutType &timeout = SyncTimeoutDeedlock,
+                const std::source_location &location = std::source_location::current()) {
+            return make_auto<false>(timeout, location);
+        }
+
+        inline auto lock_const(const SyncTimeoutType &timeout = SyncTimeoutDeedlock,
+                const std::source_location &location = std::source_location::current()) const {
+            return make_auto<true>(timeout, location);
+        }
+
+        inline TryLockResult<Locker<typename T::ValueType, typename T::SharedType>> try_lock(const SyncTimeoutType &timeout = SyncTimeoutDeedlock,
+                const std::source_location &location = std::source_location::current()) {
+            if (!owned_by_current_thread()) [[unlikely]] {
+                return try_lock_error<Locker<typename T::ValueType, typename T::SharedType>>(errc::wrong_thread);
+            }
+            return T::template make_try<false>(this->T::WeakType::lock(), timeout, location);
+        }
+
+        inline auto try_lock_const(const SyncTimeoutType &timeout = SyncTimeoutDeedlock,
+                const std::source_location &location = std::source_location::current()) const {
+            typedef decltype(T::template make_try<true>(std::declval<typename T::SharedType>(), timeout, location)) ResultType;
+            if (!owned_by_current_thread()) [[unlikely]] {
+                return ResultType(try_lock_error<typename ResultType::value_type>(errc::wrong_thread));
+            }
+            return T::template make_try<true>(this->T::WeakType::lock(), timeout, location);
+        }
+
+        inline UpgradableLocker<typename T::ValueType, typename T::SharedType> lock_upgradable(const SyncTimeoutType &timeout = SyncTimeoutDeedlock,
+                const std::source_location &location = std::source_location::current()) const
+        requires std::is_base_of_v<SyncUpgradableShared<typename T::ValueType>, typename T::DataType> {
+            typename T::SharedType shared = promote();
+            return T::make_upgradable(&shared, timeout, location);
+        }
+
+//        template < typename = std::enable_if<std::is_trivially_copyable_v < V >> >
+        inline T::ValueType & operator*() const {
+            auto guard_lock = lock_const();
+            return *guard_lock;
+        }
+
+//        template < typename = std::enable_if<std::is_trivially_copyable_v < V >> >
+        inline Weak<T> & operator=(T::ValueType && value) {
+            auto guard_lock = lock();
+            *guard_lock = std::move(value);
+            return *this;
+        }
+
+        inline Weak<T> & set(T::ValueType && value, const SyncTimeoutType &timeout = SyncTimeoutDeedlock) {
+            auto guard_lock = lock(timeout);
+            *guard_lock = std::move(value);
+            return *this;
+        }
+
+        /*
+         * Lock-free access to data of the shared variable with @ref SyncAtomic policy
+         * (the weak reference is captured only for the duration of the atomic operation)
+         */
+
+        typedef typename T::ValueType AtomicType;
+        static constexpr bool is_atomic = std::is_base_of_v<SyncAtomic<AtomicType>, typename T::DataType>;
+
+        inline AtomicType load(std::memory_order order = std::memory_order_seq_cst) const requires is_atomic {
+            typename T::SharedType shared = promote();
+            return T::get_data(&shared).atomic().load(order);
+        }
+
+        inline T::ValueType load() const requires std::is_base_of_v<SyncSeqLock<typename T::ValueType>, typename T::DataType> {
+            typename T::SharedType shared = promote();
+            return T::get_data(&shared).load();
+        }
+
+        /*
+         * Copy of the value, a callable and a batch of fields under one read lock (see @ref Shared::load and @ref Shared::visit)
+         */
+
+        inline T::ValueType load(const SyncTimeoutType &timeout = SyncTimeoutDeedlock,
+                const std::source_location &location = std::source_location::current()) const requires (!T::is_lock_free) {
+            auto guard_lock = lock_const(timeout, location);
+            return *guard_lock;
+        }
+
+        template <typename F>
+        inline auto visit(F && func, const SyncTimeoutType &timeout = SyncTimeoutDeedlock,
+                const std::source_location &location = std::source_location::current()) const
+        -> std::decay_t<std::invoke_result_t<F, const typename T::ValueType &>> {
+            if constexpr (T::is_lock_free) {
+                const typename T::ValueType value = load();
+                return std::invoke(std::forward<F>(func), value);
+            } else {
+                auto guard_lock = lock_const(timeout, location);
+                return std::invoke(std::forward<F>(func), *guard_lock);
+            }
+        }
+
+        template <typename ... M>
+        inline auto load(M ... fields) const requires (sizeof...(M) > 0 && (std::is_member_pointer_v<M> && ...)) {
+            return visit([&](const typename T::ValueType & value) {
+                return std::make_tuple(std::invoke(fields, value)...);
+            });
+        }
+
+        inline void store(AtomicType value, std::memory_order order = std::memory_order_seq_cst) const requires is_atomic {
+            typename T::SharedType shared = promote();
+            T::get_data(&shared).atomic().store(value, order);
+        }
+
+        inline AtomicType exchange(AtomicType value, std::memory_order order = std::memory_order_seq_cst) const requires is_atomic {
+            typename T::SharedType shared = promote();
+            return T::get_data(&shared).atomic().exchange(value, order);
+        }
+
+        inline bool compare_exchange(AtomicType & expected, AtomicType desired, std::memory_order order = std::memory_order_seq_cst) const requires is_atomic {
+            typename T::SharedType shared = promote();
+            return T::get_data(&shared).atomic().compare_exchange_strong(expected, desired, order);
+        }
+
+        inline AtomicType fetch_add(AtomicType arg, std::memory_order order = std::memory_order_seq_cst) const requires is_atomic {
+            typename T::SharedType shared = promote();
+            return T::get_data(&shared).atomic().fetch_add(arg, order);
+        }
+
+        inline AtomicType fetch_sub(AtomicType arg, std::memory_order order = std::memory_order_seq_cst) const requires is_atomic {
+            typename T::SharedType shared = promote();
+            return T::get_data(&shared).atomic().fetch_sub(arg, order);
+        }
+
+        inline AtomicType fetch_and(AtomicType arg, std::memory_order order = std::memory_order_seq_cst) const requires is_atomic {
+            typename T::SharedType shared = promote();
+            return T::get_data(&shared).atomic().fetch_and(arg, order);
+        }
+
+        inline AtomicType fetch_or(AtomicType arg, std::memory_order order = std::memory_order_seq_cst) const requires is_atomic {
+            typename T::SharedType shared = promote();
+            return T::get_data(&shared).atomic().fetch_or(arg, order);
+        }
+
+        inline AtomicType fetch_xor(AtomicType arg, std::memory_order order = std::memory_order_seq_cst) const requires is_atomic {
+            typename T::SharedType shared = promote();
+            return T::get_data(&shared).atomic().fetch_xor(arg, order);
+        }
+
+        /*
+         * Validity check by the use count of the weak pointer without capturing the data
+         */
+        inline bool expired() const noexcept {
+            return T::WeakType::expired();
+        }
+
+        inline explicit operator bool() const noexcept {
+            return !expired();
+        }
+    SCOPE(protected):
+
+        /*
+         * The non-atomic reference counter of the single thread data (@ref LocalShared) 
+         * is changed by the promotion, so the owner thread is checked before it
+         */
+        inline bool owned_by_current_thread() const noexcept {
+            if constexpr (std::is_same_v<typename T::SharedType, LocalShared<typename T::DataType>>) {
+                return T::WeakType::owned_by_current_thread();
+            } else {
+                return true;
+            }
+        }
+
+        inline typename T::SharedType promote() const {
+            if (!owned_by_current_thread()) [[unlikely]] {
+                throw memsafe_error("Using a single thread variable in another thread!");
+            }
+            return this->T::WeakType::lock();
+        }
+    };
+
+    /**
+     * A class without a synchronization primitive and with the ability to work only in one application thread.   
+     * Used to control access to data from only one application thread without creating a synchronization object between threads.
+     * @ref Shared and @ref Weak with this policy use a non-atomic reference counter (see @ref LocalShared).
+     */
+    template <typename V>
+    class SyncSingleThread : public SyncPolicy<V, SyncSingleThread<V>> {
+    public:
+
+        template <typename ... Args>
+        SyncSingleThread(Args && ... args) : SyncPolicy<V, SyncSingleThread<V>>(std::forward<Args>(args)...), m_thread(current_thread()) {
+        }
+
+        /**
+         * Hand-off of the variable to the current thread (between pipeline stages). 
+         * The hand-off must be synchronized by the caller (for example, by a queue between the stages) 
+         * and the previous thread must not use the variable after it, @ref Shared::transfer_to_current_thread 
+         * checks that no other references to the data remain.
+         */
+        inline void transfer_to_current_thread() {
+            m_thread = current_thread();
+        }
+
+        inline errc TryLockError(const SyncTimeoutType &timeout) const {
+            if (m_thread != current_thread()) {
+                return errc::wrong_thread;
+            }
+            return Sync<V>::TryLockError(timeout);
+        }
+
+    protected:
+        friend class SyncPolicy<V, SyncSingleThread<V>>;
+
+        const void * m_thread;
+
+        // The same token as the owner of the reference counter of LocalShared
+        static inline const void * current_thread() {
+            return LocalControl::current_thread();
+        }
+
+        inline void check_thread() {
+            if (m_thread != current_thread()) [[unlikely]] {
+                throw memsafe_error("Using a single thread variable in another thread!");
+            }
+        }
+
+        inline bool try_lock(const SyncTimeoutType &timeout) {
+            check_thread();
+            Sync<V>::timeout_set_error(timeout);
+            return true;
+        }
+
+        inline void unlock() {
+            check_thread();
+        }
+
+        inline bool try_lock_const(const SyncTimeoutType &timeout) {
+            check_thread();
+            Sync<V>::timeout_set_error(timeout);
+            return true;
+        }
+
+        inline void unlock_const() {
+            check_thread();
+        }
+    };
+
+    /**
+     * Class with timed mutex for simple multithreaded synchronization
+     */
+
+    template <typename V>
+    class SyncTimedMutex : public SyncPolicy<V, SyncTimedMutex<V>>, protected std::timed_mutex {
+    public:
+
+        template <typename ... Args>
+        SyncTimedMutex(Args && ... args) : SyncPolicy<V, SyncTimedMutex<V>>(std::forward<Args>(args)...) {
+        }
+
+    protected:
+        friend class SyncPolicy<V, SyncTimedMutex<V>>;
+
+        inline bool try_lock(const SyncTimeoutType &timeout) {
+
+            return std::timed_mutex::try_lock_for(timeout);
+        }
+
+        inline void unlock() {
+
+            std::timed_mutex::unlock();
+        }
+
+        inline bool try_lock_const(const SyncTimeoutType &timeout) {
+
+            return std::timed_mutex::try_lock_for(timeout);
+        }
+
+        inline void unlock_const() {
+
+            std::timed_mutex::unlock();
+        }
+    };
+
+    /**
+     * Class with shared_timed_mutex for multi-thread synchronization for exclusive read/write lock or shared read-only lock
+     */
+
+    template <typename V>
+    class SyncTimedShared : public SyncPolicy<V, SyncTimedShared<V>>, protected std::shared_timed_mutex {
+    public:
+
+        template <typename ... Args>
+        SyncTimedShared(Args && ... args) : SyncPolicy<V, SyncTimedShared<V>>(std::forward<Args>(args)...) {
+        }
+
+    protected:
+        friend class SyncPolicy<V, SyncTimedShared<V>>;
+
+        inline bool try_lock(const SyncTimeoutType &timeout) {
+            return std::shared_timed_mutex::try_lock_for(timeout);
+        }
+
+        inline void unlock() {
+            std::shared_timed_mutex::unlock();
+        }
+
+        inline bool try_lock_const(const SyncTimeoutType &timeout) {
+            return std::shared_timed_mutex::try_lock_shared_for(timeout);
+        }
+
+        inline void unlock_const() {
+            std::shared_timed_mutex::unlock_shared();
+        }
+    };
+
+    /**
+     * Lock-free shared data for trivially copyable types that are always lock-free as std::atomic<V>.
+     * 
+     * There is no synchronization object, access to data is possible only with atomic operations 
+     * (load, store, exchange, compare_exchange and fetch_*) of @ref Shared and @ref Weak, 
+     * capturing the data with lock() or lock_const() is prohibited at compile time.
+     */
+
+    template <typename V>
+    class alignas(std::atomic_ref<V>::required_alignment) SyncAtomic : public Sync<V> {
+    public:
+
+        static_assert(std::is_trivially_copyable_v<V>);
+        static_assert(std::atomic<V>::is_always_lock_free, "SyncAtomic is only applicable for lock-free types");
+
+        template <typename ... Args>
+        SyncAtomic(Args && ... args) : Sync<V>(std::forward<Args>(args)...) {
+        }
+
+        inline std::atomic_ref<V> atomic() {
+            return std::atomic_ref<V>(this->data);
+        }
+
+        // Direct access to data bypassing atomic operations is not allowed
+        bool TryLock(bool const_lock, const SyncTimeoutType &timeout = SyncTimeoutDeedlock) = delete;
+        void UnLock(bool const_lock) = delete;
+    };
+
+    /**
+     * Sequence lock for read-mostly shared data of trivially copyable types.
+     * 
+     * Writers capture the data with lock() (timed mutex) and increment the sequence number 
+     * before and after changing the data. Readers copy the data with load() optimistically 
+     * and retry if the sequence number has changed, so they never write to shared memory.
+     * 
+     * The read only capture lock_const() is also available, but it is serialized with writers.
+     */
+
+    template <typename V>
+    class SyncSeqLock : public SyncPolicy<V, SyncSeqLock<V>>, protected std::timed_mutex {
+    public:
+
+        static_assert(std::is_trivially_copyable_v<V>, "SyncSeqLock is only applicable for trivially copyable types");
+
+        template <typename ... Args>
+        SyncSeqLock(Args && ... args) : SyncPolicy<V, SyncSeqLock<V>>(std::forward<Args>(args)...), m_sequence(0) {
+        }
+
+        V load() const {
+            std::array<std::byte, sizeof (V) > buffer;
+            while (true) {
+                const uint64_t sequence = m_sequence.load(std::memory_order_acquire);
+                if (sequence & 1) { // The writer is changing the data
+                    std::this_thread::yield();
+                    continue;
+                }
+                std::memcpy(buffer.data(), &this->data, sizeof (V));
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (m_sequence.load(std::memory_order_relaxed) == sequence) {
+                    return std::bit_cast<V>(buffer);
+                }
+            }
+        }
+
+    protected:
+        friend class SyncPolicy<V, SyncSeqLock<V>>;
+
+        std::atomic<uint64_t> m_sequence;
+
+        inline bool try_lock(const SyncTimeoutType &timeout) {
+            if (!std::timed_mutex::try_lock_for(timeout)) {
+                return false;
+            }
+            m_sequence.store(m_sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            return true;
+        }
+
+        inline void unlock() {
+            m_sequence.store(m_sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            std::timed_mutex::unlock();
+        }
+
+        inline bool try_lock_const(const SyncTimeoutType &timeout) {
+            return std::timed_mutex::try_lock_for(timeout);
+        }
+
+        inline void unlock_const() {
+            std::timed_mutex::unlock();
+        }
+    };
+
+    /**
+     * Read-copy-update policy for read-mostly shared data with immutable published snapshots.
+     * 
+     * Readers get the current snapshot with lock_const() without any lock, 
+     * the @ref Locker pins the snapshot (std::shared_ptr<const V>) for its lifetime.
+     * 
+     * Writers are serialized by a timed mutex and modify the working data in place, 
+     * the copy of the modified data is published as a new snapshot atomically when the @ref Locker is released, 
+     * so the working data is always valid and equal to the current snapshot.
+     * 
+     * If the writer's Locker is destroyed by the stack unwinding of an exception, 
+     * the half-modified data is not published and the next writer starts from the current snapshot.
+     */
+
+    template <typename V>
+    class SyncRcu : public SyncPolicy<V, SyncRcu<V>>, protected std::timed_mutex {
+    public:
+
+        typedef std::shared_ptr<const V> SnapshotType;
+
+        template <typename ... Args>
+        SyncRcu(Args && ... args) : SyncPolicy<V, SyncRcu<V>>(std::forward<Args>(args)...), m_snapshot(std::make_shared<const V>(this->data)) {
+        }
+
+        inline SnapshotType snapshot() const {
+            return m_snapshot.load(std::memory_order_acquire);
+        }
+
+    protected:
+        friend class SyncPolicy<V, SyncRcu<V>>;
+
+        std::atomic<SnapshotType> m_snapshot;
+        // Guarded by the mutex: the number of uncaught exceptions when the writer acquired the lock 
+        // and the working data is left unpublished by the writer interrupted by an exception
+        int m_exceptions = 0;
+        bool m_aborted = false;
+
+        inline bool try_lock(const SyncTimeoutType &timeout) {
+            if (!std::timed_mutex::try_lock_for(timeout)) {
+                return false;
+            }
+            if (m_aborted) [[unlikely]] {
+                try {
+                    this->data = *m_snapshot.load(std::memory_order_relaxed);
+                } catch (...) {
+                    std::timed_mutex::unlock();
+                    throw;
+                }
+                m_aborted = false;
+            }
+            m_exceptions = std::uncaught_exceptions();
+            return true;
+        }
+
+        inline void unlock() {
+            if (std::uncaught_exceptions() > m_exceptions) [[unlikely]] {
+                m_aborted = true; // Stack unwinding, the modification is not complete
+            } else {
+                m_snapshot.store(std::make_shared<const V>(this->data), std::memory_order_release);
+            }
+            std::timed_mutex::unlock();
+        }
+
+        // The working data is equal to the current snapshot, nothing to publish
+        inline void unlock_unchanged() {
+            std::timed_mutex::unlock();
+        }
+
+        inline bool try_lock_const(const SyncTimeoutType &timeout) {
+            return std::timed_mutex::try_lock_for(timeout);
+        }
+
+        inline void unlock_const() {
+            std::timed_mutex::unlock();
+        }
+    };
+
+#ifdef __linux__
+
+    /**
+     * Timed mutex based on Linux futex.
+     * 
+     * Lock without contention takes a single CAS without reading the clock, 
+     * the deadline is calculated and the thread waits on the futex only if the mutex is already locked.
+     * 
+     * State of mutex: 0 - unlocked, 1 - locked, 2 - locked and there may be waiting threads.
+     */
+
+    class FutexTimedMutex {
+    public:
+
+        FutexTimedMutex() : m_state(0) {
+        }
+
+        [[nodiscard]]
+        inline bool try_lock() {
+            uint32_t expected = 0;
+            return m_state.load(std::memory_order_relaxed) == 0
+                    && m_state.compare_exchange_strong(expected, 1, std::memory_order_acquire, std::memory_order_relaxed);
+        }
+
+        [[nodiscard]]
+        inline bool try_lock_for(const SyncTimeoutType &timeout) {
+            uint32_t expected = 0;
+            if (m_state.compare_exchange_strong(expected, 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+                return true;
+            }
+            return lock_contended(timeout);
+        }
+
+        inline void unlock() {
+            if (m_state.exchange(0, std::memory_order_release) == 2) {
+                syscall(SYS_futex, reinterpret_cast<uint32_t *> (&m_state), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+            }
+        }
+
+    protected:
+        std::atomic<uint32_t> m_state;
+
+        bool lock_contended(const SyncTimeoutType &timeout) {
+            const auto deadline = std::chrono::steady_clock::now() + timeout;
+            while (m_state.exchange(2, std::memory_order_acquire) != 0) {
+                const auto now = std::chrono::steady_clock::now();
+                if (now >= deadline) {
+                    return false;
+                }
+                const auto wait = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline - now);
+                struct timespec ts;
+                ts.tv_sec = wait.count() / 1'000'000'000;
+                ts.tv_nsec = wait.count() % 1'000'000'000;
+                // Relative timeout of FUTEX_WAIT is measured by CLOCK_MONOTONIC as well as std::chrono::steady_clock
+                syscall(SYS_futex, reinterpret_cast<uint32_t *> (&m_state), FUTEX_WAIT_PRIVATE, 2, &ts, nullptr, 0);
+            }
+            return true;
+        }
+    };
+
+    static_assert(sizeof (std::atomic<uint32_t>) == sizeof (uint32_t));
+
+    /**
+     * Class with futex based timed mutex for simple multithreaded synchronization 
+     * with minimal overhead when there is no contention (see @ref FutexTimedMutex).
+     */
+
+    template <typename V>
+    class SyncFutexMutex : public SyncPolicy<V, SyncFutexMutex<V>>, protected FutexTimedMutex {
+    public:
+
+        template <typename ... Args>
+        SyncFutexMutex(Args && ... args) : SyncPolicy<V, SyncFutexMutex<V>>(std::forward<Args>(args)...) {
+        }
+
+    protected:
+        friend class SyncPolicy<V, SyncFutexMutex<V>>;
+
+        inline bool try_lock(const SyncTimeoutType &timeout) {
+            return FutexTimedMutex::try_lock_for(timeout);
+        }
+
+        inline void unlock() {
+            FutexTimedMutex::unlock();
+        }
+
+        inline bool try_lock_const(const SyncTimeoutType &timeout) {
+            return FutexTimedMutex::try_lock_for(timeout);
+        }
+
+        inline void unlock_const() {
+            FutexTimedMutex::unlock();
+        }
+    };
+
+    typedef FutexTimedMutex ParkingTimedMutex;
+
+#else
+
+    // Futex is not available, use the standard timed mutex
+    template <typename V> using SyncFutexMutex = SyncTimedMutex<V>;
+
+    typedef std::timed_mutex ParkingTimedMutex;
+
+#endif
+
+    /**
+     * Spin budget of @ref SyncSpinMutex for a specific data type.
+     * 
+     * The template can be specialized for the data type to set the maximum number 
+     * of spin iterations (pause instructions) before the thread is parked, zero disables spinning.
+     */
+
+    template <typename V>
+    struct SyncSpinTraits {
+        static constexpr size_t spin_count = 1024;
+    };
+
+    inline void spin_pause() {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__)
+        asm volatile("yield");
+#else
+        std::this_thread::yield();
+#endif
+    }
+
+    /**
+     * Adaptive timed mutex: spins with exponential backoff for at most spin_count pause instructions,
+     * and then the thread is parked in @ref ParkingTimedMutex until the lock is released or the timeout expires.
+     */
+
+    template <size_t spin_count>
+    class SpinTimedMutex : protected ParkingTimedMutex {
+    public:
+
+        static constexpr size_t SpinBackoffLimit = 64;
+
+        [[nodiscard]]
+        inline bool try_lock_for(const SyncTimeoutType &timeout) {
+            size_t backoff = 1;
+            for (size_t spin = 0; spin < spin_count; spin += backoff) {
+                if (ParkingTimedMutex::try_lock()) {
+                    return true;
+                }
+                for (size_t i = 0; i < backoff; i++) {
+                    spin_pause();
+                }
+                backoff = std::min(backoff * 2, SpinBackoffLimit);
+            }
+            return ParkingTimedMutex::try_lock_for(timeout);
+        }
+
+        inline void unlock() {
+            ParkingTimedMutex::unlock();
+        }
+    };
+
+    /**
+     * Class with adaptive spin-then-park timed mutex for very short critical sections (see @ref SpinTimedMutex).
+     * The spin budget is set for the data type by specialization of the template @ref SyncSpinTraits.
+     */
+
+    template <typename V>
+    class SyncSpinMutex : public SyncPolicy<V, SyncSpinMutex<V>>, protected SpinTimedMutex<SyncSpinTraits<V>::spin_count> {
+    public:
+
+        typedef SpinTimedMutex<SyncSpinTraits<V>::spin_count> MutexType;
+
+        template <typename ... Args>
+        SyncSpinMutex(Args && ... args) : SyncPolicy<V, SyncSpinMutex<V>>(std::forward<Args>(args)...) {
+        }
+
+    protected:
+        friend class SyncPolicy<V, SyncSpinMutex<V>>;
+
+        inline bool try_lock(const SyncTimeoutType &timeout) {
+            return MutexType::try_lock_for(timeout);
+        }
+
+        inline void unlock() {
+            MutexType::unlock();
+        }
+
+        inline bool try_lock_const(const SyncTimeoutType &timeout) {
+            return MutexType::try_lock_for(timeout);
+        }
+
+        inline void unlock_const() {
+            MutexType::unlock();
+        }
+    };
+
+    /**
+     * Biased timed mutex for data that is almost always used by only one thread.
+     * 
+     * The first thread that captures the mutex becomes its owner and then captures and releases it 
+     * using only plain loads and stores (without atomic read-modify-write operations).
+     * When another thread tries to capture the mutex, the bias is revoked: 
+     * the owner thread is synchronized with an asymmetric memory barrier (membarrier on Linux), 
+     * and from that moment on all threads, including the former owner, use @ref ParkingTimedMutex.
+     * 
+     * A recursive capture in the owner thread while the bias is active fails without waiting for the timeout.
+     */
+
+    class BiasedTimedMutex {
+    public:
+
+        enum BiasState : uint32_t {
+            BiasActive = 0,
+            BiasRevoking = 1,
+            BiasRevoked = 2,
+        };
+
+        BiasedTimedMutex() : m_owner(), m_bias(BiasActive), m_owner_locked(0) {
+        }
+
+        [[nodiscard]]
+        bool try_lock_for(const SyncTimeoutType &timeout) {
+            if (m_bias.load(std::memory_order_relaxed) == BiasActive) {
+                const std::thread::id current = std::this_thread::get_id();
+                std::thread::id owner = m_owner.load(std::memory_order_relaxed);
+                if (owner == std::thread::id() && m_owner.compare_exchange_strong(owner, current)) {
+                    owner = current; // First capture - the current thread becomes the owner of the bias
+                }
+                if (owner == current) {
+                    if (m_owner_locked.load(std::memory_order_relaxed)) {
+                        return false;
+                    }
+                    m_owner_locked.store(1, std::memory_order_relaxed);
+                    owner_barrier();
+                    if (m_bias.load(std::memory_order_relaxed) == BiasActive) {
+                        return true;
+                    }
+                    // The bias was revoked concurrently
+                    m_owner_locked.store(0, std::memory_order_release);
+                } else {
+                    revoke();
+                }
+            }
+            return lock_revoked(timeout);
+        }
+
+        void unlock() {
+            if (m_owner_locked.load(std::memory_order_relaxed) && m_owner.load(std::memory_order_relaxed) == std::this_thread::get_id()) {
+                m_owner_locked.store(0, std::memory_order_release);
+            } else {
+                m_mutex.unlock();
+            }
+        }
+
+        inline bool is_biased() const {
+            return m_bias.load(std::memory_order_relaxed) == BiasActive;
+        }
+
+    protected:
+        std::atomic<std::thread::id> m_owner;
+        std::atomic<uint32_t> m_bias;
+        std::atomic<uint32_t> m_owner_locked; // Written only by the owner thread
+        ParkingTimedMutex m_mutex;
+
+        // Light side of the asymmetric barrier executed by the owner thread
+        static inline void owner_barrier() {
+#ifdef __linux__
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+#else
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+#endif
+        }
+
+        // Heavy side of the asymmetric barrier, forces a memory barrier on all running threads of the process
+        static void revoke_barrier() {
+#ifdef __linux__
+            static const bool expedited = syscall(SYS_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0) == 0;
+            if (!(expedited && syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0) == 0)
+                    && syscall(SYS_membarrier, MEMBARRIER_CMD_GLOBAL, 0, 0) != 0) {
+                throw memsafe_error("The membarrier system call is not supported!");
+            }
+#endif
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+
+        void revoke() {
+            uint32_t expected = BiasActive;
+            if (m_bias.compare_exchange_strong(expected, BiasRevoking)) {
+                revoke_barrier();
+                m_bias.store(BiasRevoked, std::memory_order_release);
+            }
+        }
+
+        bool lock_revoked(const SyncTimeoutType &timeout) {
+            const auto deadline = std::chrono::steady_clock::now() + timeout;
+            // Wait until the owner thread is synchronized by the thread that revokes the bias
+            while (m_bias.load(std::memory_order_acquire) != BiasRevoked) {
+                if (std::chrono::steady_clock::now() >= deadline) {
+                    return false;
+                }
+                std::this_thread::yield();
+            }
+            if (!m_mutex.try_lock_for(std::chrono::duration_cast<SyncTimeoutType>(deadline - std::chrono::steady_clock::now()))) {
+                return false;
+            }
+            // Wait until the owner thread leaves the critical section captured before the bias was revoked
+            while (m_owner_locked.load(std::memory_order_acquire)) {
+                if (std::chrono::steady_clock::now() >= deadline) {
+                    m_mutex.unlock();
+                    return false;
+                }
+                std::this_thread::yield();
+            }
+            return true;
+        }
+    };
+
+    /**
+     * Class with biased timed mutex for data that rarely migrates between threads (see @ref BiasedTimedMutex).
+     */
+
+    template <typename V>
+    class SyncBiasedMutex : public SyncPolicy<V, SyncBiasedMutex<V>>, protected BiasedTimedMutex {
+    public:
+
+        template <typename ... Args>
+        SyncBiasedMutex(Args && ... args) : SyncPolicy<V, SyncBiasedMutex<V>>(std::forward<Args>(args)...) {
+        }
+
+        using BiasedTimedMutex::is_biased;
+
+    protected:
+        friend class SyncPolicy<V, SyncBiasedMutex<V>>;
+
+        inline bool try_lock(const SyncTimeoutType &timeout) {
+            return BiasedTimedMutex::try_lock_for(timeout);
+        }
+
+        inline void unlock() {
+            BiasedTimedMutex::unlock();
+        }
+
+        inline bool try_lock_const(const SyncTimeoutType &timeout) {
+            return BiasedTimedMutex::try_lock_for(timeout);
+        }
+
+        inline void unlock_const() {
+            BiasedTimedMutex::unlock();
+        }
+    };
+
+    /**
+     * Timed shared mutex with an upgradable mode for the "check, then modify" pattern.
+     * 
+     * The upgradable owner coexists with plain readers, but only one upgradable owner can exist at a time, 
+     * so it can be promoted to the exclusive owner without releasing the lock (no other writer can intervene).
+     * While the upgrade waits for the readers to leave, new readers are not admitted.
+     * The exclusive lock obtained by the upgrade returns to the upgradable mode on unlock, 
+     * and the upgradable owner can be downgraded to a plain reader.
+     */
+
+    class UpgradableTimedMutex {
+    public:
+
+        bool try_lock_for(const SyncTimeoutType &timeout) {
+            std::unique_lock<std::mutex> guard(m_mutex);
+            if (!wait_for(guard, timeout, [this]() {
+                    return !m_writer && !m_upgradable && !m_readers;
+                })) {
+                return false;
+            }
+            m_writer = true;
+            return true;
+        }
+
+        void unlock() {
+            std::unique_lock<std::mutex> guard(m_mutex);
+            m_writer = false; // The writer after the upgrade remains the upgradable owner
+            notify(guard);
+        }
+
+        bool try_lock_shared_for(const SyncTimeoutType &timeout) {
+            std::unique_lock<std::mutex> guard(m_mutex);
+            if (!wait_for(guard, timeout, [this]() {
+                    return !m_writer && !m_upgrading;
+                })) {
+                return false;
+            }
+            m_readers++;
+            return true;
+        }
+
+        void unlock_shared() {
+            std::unique_lock<std::mutex> guard(m_mutex);
+            if (!--m_readers) {
+                notify(guard);
+            }
+        }
+
+        bool try_lock_upgrade_for(const SyncTimeoutType &timeout) {
+            std::unique_lock<std::mutex> guard(m_mutex);
+            if (!wait_for(guard, timeout, [this]() {
+                    return !m_writer && !m_upgradable;
+                })) {
+                return false;
+            }
+            m_upgradable = true;
+            return true;
+        }
+
+        void unlock_upgrade() {
+            std::unique_lock<std::mutex> guard(m_mutex);
+            m_upgradable = false;
+            notify(guard);
+        }
+
+        bool try_upgrade_for(const SyncTimeoutType &timeout) {
+            std::unique_lock<std::mutex> guard(m_mutex);
+            m_upgrading = true;
+            bool result = wait_for(guard, timeout, [this]() {
+                return !m_readers;
+            });
+            m_upgrading = false;
+            if (result) {
+                m_writer = true;
+            } else {
+                notify(guard); // Admit the readers waiting for the upgrade
+            }
+            return result;
+        }
+
+        // The upgradable owner is the only possible writer, so the writer is its upgrade
+        bool upgraded() {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            return m_writer;
+        }
+
+        void downgrade_shared() {
+            std::unique_lock<std::mutex> guard(m_mutex);
+            m_upgradable = false;
+            m_readers++;
+            notify(guard);
+        }
+
+    protected:
+        std::mutex m_mutex;
+        std::condition_variable m_cond;
+        uint32_t m_waiters = 0;
+        uint32_t m_readers = 0;
+        bool m_upgradable = false;
+        bool m_upgrading = false;
+        bool m_writer = false;
+
+        template <typename P>
+        inline bool wait_for(std::unique_lock<std::mutex> &guard, const SyncTimeoutType &timeout, P pred) {
+            if (pred()) {
+                return true;
+            }
+            m_waiters++;
+            bool result = m_cond.wait_for(guard, timeout, pred);
+            m_waiters--;
+            return result;
+        }
+
+        // The condition variable is notified only if someone is waiting
+        inline void notify(std::unique_lock<std::mutex> &guard) {
+            if (m_waiters) {
+                guard.unlock();
+                m_cond.notify_all();
+            }
+        }
+    };
+
+    /**
+     * Class with a timed shared mutex with an upgradable read lock (see @ref Shared::lock_upgradable)
+     */
+
+    template <typename V>
+    class SyncUpgradableShared : public SyncPolicy<V, SyncUpgradableShared<V>>, protected UpgradableTimedMutex {
+    public:
+
+        template <typename ... Args>
+        SyncUpgradableShared(Args && ... args) : SyncPolicy<V, SyncUpgradableShared<V>>(std::forward<Args>(args)...) {
+        }
+
+        [[nodiscard]]
+        inline bool TryLockUpgradable(const SyncTimeoutType &timeout = SyncTimeoutDeedlock) {
+            return UpgradableTimedMutex::try_lock_upgrade_for(timeout);
+        }
+
+        inline void UnLockUpgradable() {
+            UpgradableTimedMutex::unlock_upgrade();
+        }
+
+        [[nodiscard]]
+        inline bool TryUpgrade(const SyncTimeoutType &timeout = SyncTimeoutDeedlock) {
+            return UpgradableTimedMutex::try_upgrade_for(timeout);
+        }
+
+        inline void DowngradeShared() {
+            UpgradableTimedMutex::downgrade_shared();
+        }
+
+        // Only for the upgradable owner
+        [[nodiscard]]
+        inline bool Upgraded() {
+            return UpgradableTimedMutex::upgraded();
+        }
+
+    protected:
+        friend class SyncPolicy<V, SyncUpgradableShared<V>>;
+
+        inline bool try_lock(const SyncTimeoutType &timeout) {
+            return UpgradableTimedMutex::try_lock_for(timeout);
+        }
+
+        inline void unlock() {
+            UpgradableTimedMutex::unlock();
+        }
+
+        inline bool try_lock_const(const SyncTimeoutType &timeout) {
+            return UpgradableTimedMutex::try_lock_shared_for(timeout);
+        }
+
+        inline void unlock_const() {
+            UpgradableTimedMutex::unlock_shared();
+        }
+    };
+
+    /**
+     * Class with a read/write lock for coroutines (see @ref Shared::lock_async and @ref Shared::lock_const_async).
+     * 
+     * Waiting coroutines and threads are queued in FIFO order, the lock is handed over to the queued waiters 
+     * on release: readers at the head of the queue are granted together, a writer alone. 
+     * The granted coroutines are resumed by the releasing thread after the internal mutex is unlocked.
+     * Blocking lock() and lock_const() wait in the same queue.
+     */
+
+    template <typename V>
+    class SyncAsyncMutex : public SyncPolicy<V, SyncAsyncMutex<V>> {
+    public:
+
+        template <typename ... Args>
+        SyncAsyncMutex(Args && ... args) : SyncPolicy<V, SyncAsyncMutex<V>>(std::forward<Args>(args)...) {
+        }
+
+        [[nodiscard]]
+        inline bool TryLockNow(bool const_lock) {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            return grant(const_lock);
+        }
+
+        /*
+         * Returns false if the lock was granted without waiting or the waiter was already cancelled
+         */
+        inline bool EnqueueAsync(AsyncWaiter & node) {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            if (node.state != AsyncWaiter::Idle) {
+                return false;
+            }
+            if (grant(node.const_lock)) {
+                node.state = AsyncWaiter::Granted;
+                return false;
+            }
+            push(node);
+            return true;
+        }
+
+        /*
+         * Returns true if the queued waiter was removed and must be resumed by the caller
+         */
+        inline bool CancelAsync(AsyncWaiter & node, AsyncWaiter::State state) {
+            AsyncWaiter * ready = nullptr;
+            bool result = false;
+            {
+                std::lock_guard<std::mutex> guard(m_mutex);
+                if (node.state == AsyncWaiter::Queued) {
+                    unlink(node);
+                    ready = dispatch(); // The next waiters could be blocked only by the removed one
+                    result = true;
+                }
+                if (node.state == AsyncWaiter::Idle || node.state == AsyncWaiter::Queued) {
+                    node.state = state;
+                }
+            }
+            resume(ready);
+            return result;
+        }
+
+    protected:
+        friend class SyncPolicy<V, SyncAsyncMutex<V>>;
+
+        std::mutex m_mutex;
+        std::condition_variable m_condition;
+        int m_count = 0; // The number of readers or -1 for the writer
+        AsyncWaiter * m_head = nullptr;
+        AsyncWaiter * m_tail = nullptr;
+
+        // Waiters in the queue are not overtaken
+        inline bool grant(bool const_lock) {
+            if (m_head) {
+                return false;
+            } else if (const_lock ? m_count >= 0 : m_count == 0) {
+                m_count = const_lock ? m_count + 1 : -1;
+                return true;
+            }
+            return false;
+        }
+
+        inline void push(AsyncWaiter & node) {
+            node.state = AsyncWaiter::Queued;
+            node.prev = m_tail;
+            node.next = nullptr;
+            (m_tail ? m_tail->next : m_head) = &node;
+            m_tail = &node;
+        }
+
+        inline void unlink(AsyncWaiter & node) {
+            (node.prev ? node.prev->next : m_head) = node.next;
+            (node.next ? node.next->prev : m_tail) = node.prev;
+            node.prev = node.next = nullptr;
+        }
+
+        /*
+         * Grants the lock to the waiters at the head of the queue, 
+         * returns the list of granted coroutines to be resumed after unlocking the mutex
+         */
+        AsyncWaiter * dispatch() {
+            AsyncWaiter * ready = nullptr;
+            AsyncWaiter ** last = &ready;
+            bool notify = false;
+            while (m_head && (m_head->const_lock ? m_count >= 0 : m_count == 0)) {
+                AsyncWaiter & node = *m_head;
+                unlink(node);
+                node.state = AsyncWaiter::Granted;
+                m_count = node.const_lock ? m_count + 1 : -1;
+                if (node.handle) {
+                    *last = &node;
+                    last = &node.next;
+                } else {
+                    notify = true;
+                }
+            }
+            if (notify) {
+                m_condition.notify_all();
+            }
+            return ready;
+        }
+
+        static inline void resume(AsyncWaiter * ready) {
+            while (ready) {
+                AsyncWaiter * node = ready;
+                ready = node->next; // The resumed coroutine can destroy the node
+                node->next = nullptr;
+                node->resume();
+            }
+        }
+
+        inline bool wait(bool const_lock, const SyncTimeoutType &timeout) {
+            AsyncWaiter * ready = nullptr;
+            {
+                std::unique_lock<std::mutex> guard(m_mutex);
+                if (grant(const_lock)) {
+                    return true;
+                }
+                AsyncWaiter node;
+                node.const_lock = const_lock;
+                push(node);
+                if (m_condition.wait_for(guard, timeout, [&node]() {
+                        return node.state != AsyncWaiter::Queued;
+                    })) {
+                    return true;
+                }
+                unlink(node);
+                ready = dispatch();
+            }
+            resume(ready);
+            return false;
+        }
 
-        [[nodiscard]]
-        virtual bool try_lock(const SyncTimeoutType &timeout = SyncTimeoutDeedlock) {
-            timeout_set_error(timeout);
-            return true;
+        inline void release(bool const_lock) {
+            AsyncWaiter * ready = nullptr;
+            {
+                std::lock_guard<std::mutex> guard(m_mutex);
+                m_count = const_lock ? m_count - 1 : 0;
+                ready = dispatch();
+            }
+            resume(ready);
         }
 
-        [[nodiscard]]
-        virtual bool try_lock_const(const SyncTimeoutType &timeout = SyncTimeoutDeedlock) {
-            timeout_set_error(timeout);
-            return true;
+        inline bool try_lock(const SyncTimeoutType &timeout) {
+            return wait(false, timeout);
         }
 
-        virtual void unlock() {
+        inline void unlock() {
+            release(false);
         }
 
-        virtual void unlock_const() {
+        inline bool try_lock_const(const SyncTimeoutType &timeout) {
+            return wait(true, timeout);
         }
 
+        inline void unlock_const() {
+            release(true);
+        }
     };
 
     /**
-     * Temporary (auto) variable - owner of object reference (dereferences weak pointers 
-     * and increments ownership count of strong references).
+     * Class of an actor - the data is owned by its own worker thread (see @ref Shared::submit).
      * 
-     * Always contains only valid data (a valid reference and a captured synchronization object), 
-     * otherwise an exception will be thrown when attempting to create the object.
+     * Instead of locking, closures are sent to the worker through a lock-free queue 
+     * of many producers and one consumer and are executed one by one in the order of submission, 
+     * so the data is never accessed by two threads and there is no lock convoy under contention.
+     * The worker sleeps on the atomic counter of the queued closures while there is no work.
+     * The data cannot be captured by lock() and lock_const().
      * 
-     * A helper template class wrapper for managing the lifetime 
-     * of captured variables and releasing their ownership in the destructor.   
-     * Similar to class and performs same functions as https://en.cppreference.com/w/cpp/thread/lock_guard
+     * A closure submitted by a closure of the same actor is queued after the already submitted ones 
+     * like any other, so a closure must not wait for the future of its own actor (it is a deadlock).
      * 
-     * V - Variable value type
-     * T - The type of the specific captured variable
+     * When the shared data is destroyed, the queued closures are executed and the worker is joined. 
+     * If the last reference is released by a closure of the actor itself, the rest of the queue 
+     * is executed by the worker inside the destructor and the worker thread is detached instead of joined.
      */
 
-    template <typename V, typename T>
-    class Locker {
+    template <typename V>
+    class SyncExecutor : public SyncPolicy<V, SyncExecutor<V>> {
     public:
 
-        Locker(T val) : value(val) {
+        template <typename ... Args>
+        SyncExecutor(Args && ... args) : SyncPolicy<V, SyncExecutor<V>>(std::forward<Args>(args)...), m_worker([this]() {
+            run();
+        }) {
         }
 
-        inline V& operator*() {
-            if constexpr (std::is_reference_v<T>) {
-                return value;
+        ~SyncExecutor() {
+            if (m_current.actor == this) {
+                // The last reference was released by the own closure, the worker must not access the actor after it
+                m_current.destroyed = true;
+                while (Task * task = pop_pending()) {
+                    if (task->invoke) {
+                        task->invoke(task, this->data);
+                    }
+                }
+                m_worker.detach();
             } else {
-                static_assert(std::is_convertible_v<T, std::shared_ptr<Sync < V>>>);
-                return value->data;
+                Task stop; // The task without the function stops the worker after the queued closures
+                post(&stop);
+                m_worker.join();
             }
         }
 
-        inline const V& operator*() const {
-            if constexpr (std::is_reference_v<T>) {
-                return value;
-            } else {
-                static_assert(std::is_convertible_v<T, std::shared_ptr<Sync < V>>>);
-                return value->data;
-            }
-        }
+        template <typename F>
+        std::future<std::invoke_result_t<F, V &>> Submit(F && fn) {
+            typedef std::invoke_result_t<F, V &> R;
 
-        inline ~Locker() {
-            if constexpr (std::is_convertible_v<T, std::shared_ptr<Sync < V>>>) {
-                value->UnLock();
-            } else {
-                static_assert(std::is_reference_v<T>);
-            }
-        }
+            struct Closure : public Task {
+                std::decay_t<F> fn;
+                std::promise<R> promise;
 
-    private:
-        T value; // Type T can be a reference to data i.e. V& or a shared_ptr<Sync<V>>
+                Closure(F && fn) : fn(std::forward<F>(fn)) {
+                }
 
-        // Noncopyable
-        Locker(const Locker&) = delete;
-        Locker& operator=(const Locker&) = delete;
-        // Nonmovable
-        Locker(Locker&&) = delete;
-        Locker& operator=(Locker&&) = delete;
-    };
+                void call(V & data) {
+                    try {
+                        if constexpr (std::is_void_v<R>) {
+                            std::invoke(fn, data);
+                            promise.set_value();
+                        } else {
+                            promise.set_value(std::invoke(fn, data));
+                        }
+                    } catch (...) {
+                        promise.set_exception(std::current_exception());
+                    }
+                }
+            };
+
+            Closure * closure = new Closure(std::forward<F>(fn));
+            std::future<R> result = closure->promise.get_future();
+            closure->invoke = [](Task * task, V & data) {
+                Closure * closure = static_cast<Closure *> (task);
+                closure->call(data);
+                delete closure;
+            };
+            post(closure);
+            return result;
+        }
 
-    /**
-     * Variable by value without references.   
-     * A simple wrapper over data to unify access to it using class Auto
-     */
-    template <typename V>
-    class Value {
     protected:
-        V value;
-    public:
 
-        Value(V val) : value(val) {
-        }
-
-        inline V& operator*() {
-            return value;
+        struct Task {
+            std::atomic<Task *> next = nullptr;
+            void (*invoke)(Task * task, V & data) = nullptr;
         };
 
-        inline const V& operator*() const {
-            return value;
+        // The actor of the current worker thread
+        struct Current {
+            SyncExecutor * actor = nullptr;
+            bool destroyed = false;
         };
 
-        inline Locker<V, V&> lock() {
-            return Locker<V, V&> (value);
+        static inline thread_local Current m_current;
+
+        // Intrusive MPSC queue with a stub node (Dmitry Vyukov), the tail is accessed only by the worker
+        Task m_stub;
+        std::atomic<Task *> m_head = &m_stub;
+        Task * m_tail = &m_stub;
+        std::atomic<uint32_t> m_pending = 0;
+        std::thread m_worker; // Started after the queue is initialized
+
+        inline void push(Task * task) {
+            task->next.store(nullptr, std::memory_order_relaxed);
+            Task * prev = m_head.exchange(task, std::memory_order_acq_rel);
+            prev->next.store(task, std::memory_order_release);
         }
 
-        inline Locker<V, V&> lock() const {
-            return lock_const();
+        inline void post(Task * task) {
+            push(task);
+            if (!m_pending.fetch_add(1, std::memory_order_release)) {
+                m_pending.notify_one();
+            }
         }
 
-        inline const Locker<V, V&> lock_const() const {
-            return Locker<V, V&> (value);
+        // Returns nullptr if the queue is empty or a producer has not linked its task yet
+        Task * pop() {
+            Task * tail = m_tail;
+            Task * next = tail->next.load(std::memory_order_acquire);
+            if (tail == &m_stub) {
+                if (!next) {
+                    return nullptr;
+                }
+                m_tail = tail = next;
+                next = next->next.load(std::memory_order_acquire);
+            }
+            if (next) {
+                m_tail = next;
+                return tail;
+            }
+            if (tail != m_head.load(std::memory_order_acquire)) {
+                return nullptr;
+            }
+            push(&m_stub);
+            next = tail->next.load(std::memory_order_acquire);
+            if (next) {
+                m_tail = next;
+                return tail;
+            }
+            return nullptr;
+        }
+
+        // The next queued task or nullptr if nothing is queued
+        Task * pop_pending() {
+            if (!m_pending.load(std::memory_order_acquire)) {
+                return nullptr;
+            }
+            Task * task;
+            while (!(task = pop())) {
+                std::this_thread::yield(); // The producer is between the exchange and the link
+            }
+            m_pending.fetch_sub(1, std::memory_order_relaxed);
+            return task;
+        }
+
+        void run() {
+            m_current.actor = this;
+            while (true) {
+                m_pending.wait(0, std::memory_order_acquire);
+                Task * task = pop_pending();
+                if (!task) {
+                    continue;
+                }
+                if (!task->invoke) {
+                    return;
+                }
+                task->invoke(task, this->data);
+                if (m_current.destroyed) { // The actor was destroyed by the closure
+                    return;
+                }
+            }
         }
     };
 
-    static_assert(std::is_standard_layout_v<Value<int>>);
+    // std::hardware_destructive_interference_size is not used because its value depends on compiler flags 
+    // and changes the layout of shared data between translation units (GCC warns about -Winterference-size)
+    static constexpr size_t SyncCacheLineSize = 64;
 
     /**
-     * Reference variable (shared pointer) with optional multi-threaded access control.
-     * 
-     * By default using template @ref Sync without multithreaded access control.
-     * @see @ref SyncSingleThread, @ref SyncTimedMutex, @ref SyncTimedShared  )
+     * Cache-line aligned layout of the synchronization policy S to eliminate false sharing 
+     * between unrelated shared variables, for example `Shared<V, Padded<SyncTimedMutex>::Policy>`.
      * 
+     * Shared data (the synchronization object and the value) is aligned to the cache line size 
+     * and its size is rounded up to a multiple of the cache line size, so no other object uses the same cache lines.
+     * Since std::make_shared places the control block in the same allocation before the aligned data, 
+     * the reference counters get a separate cache line as well.
      */
 
-    template <typename V, template <typename> typename S = Sync>
-    class Shared : public std::shared_ptr< S<V> > {
-    public:
-
-        typedef V ValueType;
-        typedef S<V> DataType;
-        typedef std::weak_ptr<DataType> WeakType;
-        typedef std::shared_ptr<DataType> SharedType;
-
-        Shared() : SharedType(nullptr) {
-        }
-
-        Shared(const V & val) : SharedType(std::make_shared<DataType>(val)) {
-        }
+    template <template <typename> typename S>
+    struct Padded {
 
-        Shared(Shared<V, S> &val) : SharedType(val) {
-        }
+        template <typename V>
+        class alignas(SyncCacheLineSize) Policy : public S<V> {
+        public:
 
-        static Locker<V, SharedType> make_auto(SharedType * shared, bool read_only, const SyncTimeoutType &timeout = SyncTimeoutDeedlock) {
-            if constexpr (!std::is_same_v<Sync<V>, DataType>) { // The Sync class is virtual
-                if (!shared || !shared->get()) {
-                    throw memsafe_error("Object missing (null pointer exception)");
-                }
-                if (!shared->get()->TryLock(read_only, timeout)) {
-                    throw memsafe_error(std::format("try_lock{} timeout", read_only ? " read only" : ""));
-                }
+            template <typename ... Args>
+            Policy(Args && ... args) : S<V>(std::forward<Args>(args)...) {
             }
-            return Locker<V, SharedType> (*shared);
-        }
+        };
+    };
 
-        Locker<V, SharedType> lock(const SyncTimeoutType &timeout = SyncTimeoutDeedlock) {
-            return make_auto(this, false, timeout);
-        }
+    /*
+     * Access to the shared pointer of the arguments of @ref lock_all (Shared or Weak variables)
+     */
 
-        Locker<V, SharedType> lock_const(const SyncTimeoutType &timeout = SyncTimeoutDeedlock) {
-            return make_auto(this, true, timeout);
-        }
+    template <typename A>
+    struct LockAllTraits;
 
-//        template < typename = std::enable_if<std::is_trivially_copyable_v < V >> >
-        inline V & operator*() const {
-            auto guard_lock = lock_const();
-            return *guard_lock;
-        }
+    template <typename V, template <typename> typename S>
+    struct LockAllTraits<Shared<V, S>> {
+        typedef Shared<V, S> SharedClass;
 
-//        template < typename = std::enable_if<std::is_trivially_copyable_v < V >> >
-        inline SharedType & operator=(V && value) {
-            auto guard_lock = lock();
-            *guard_lock = value;
-            return *this;
+        static inline typename SharedClass::SharedType shared(const Shared<V, S> &arg) {
+            return arg;
         }
+    };
 
-        inline SharedType & set(V && value, const SyncTimeoutType &timeout = SyncTimeoutDeedlock) {
-            auto guard_lock = lock(timeout);
-            *guard_lock = value;
-            return *this;
-        }
-        
-        //        template < typename = std::enable_if<std::is_trivially_copyable_v < V >> >
-        //        inline SharedType & operator=(SharedType & s) {
-        //            auto guard_lock = lock_const();
-        //            return this->memsafe::shared_ptr<S < V>>::operator*().data;
-        //        }
-        //
+    template <typename T>
+    struct LockAllTraits<Weak<T>> {
+        typedef T SharedClass;
 
-        inline Weak<Shared < V, S >> weak() {
-            return Weak<Shared < V, S >> (*this);
+        static inline typename SharedClass::SharedType shared(const Weak<T> &arg) {
+            return arg.promote();
         }
+    };
 
-        inline explicit operator bool() const noexcept {
-            return this->get();
-        }
+    template <typename A>
+    concept LockAllArgument = requires {
+        typename LockAllTraits<std::remove_const_t<A>>::SharedClass;
     };
 
     /**
-     * A wrapper template class for storing weak pointers to shared variables
+     * Temporary (auto) variable - owner of several shared variables captured at once by @ref lock_all.
+     * 
+     * Arguments passed as const are captured for read only access, the others for exclusive access.
+     * Read only arguments with @ref SyncRcu policy pin the published snapshot without lock as lock_const() does.
+     * Values are available with get<I>() or structured binding: `auto [a, b] = lock_all(var_a, std::as_const(var_b));`
      */
 
-    template <typename T>
-    class Weak : public T::WeakType {
+    template <LockAllArgument ... A>
+    class LockerAll {
     public:
 
-        Weak() : T::WeakType(nullptr) {
-        }
+        template <typename A1>
+        using SharedClass = typename LockAllTraits<std::remove_const_t<A1>>::SharedClass;
 
-        Weak(const T ptr) : T::WeakType(ptr) {
-        }
+        template <typename A1>
+        using ValueRef = std::conditional_t<std::is_const_v<A1>, const typename SharedClass<A1>::ValueType &, typename SharedClass<A1>::ValueType &>;
 
-        Weak(Weak & old) : T::WeakType(old) {
-        }
+        typedef std::tuple<typename SharedClass<A>::SharedType...> SharedTuple;
 
-        Locker<typename T::ValueType, typename T::SharedType> make_auto(bool read_only, const SyncTimeoutType &timeout = SyncTimeoutDeedlock) {
-            typename T::SharedType shared = this->T::WeakType::lock();
-            return T::make_auto(&shared, read_only, timeout);
-        }
+        template <typename A1>
+        static constexpr bool snapshot = std::is_const_v<A1>
+                && std::is_base_of_v<SyncRcu<typename SharedClass<A1>::ValueType>, typename SharedClass<A1>::DataType>;
 
-        inline Locker<typename T::ValueType, typename T::SharedType> lock(const SyncTimeoutType &timeout = SyncTimeoutDeedlock) {
-            return make_auto(false, timeout);
-        }
+        template <typename A1>
+        using SnapshotType = std::conditional_t<snapshot<A1>, std::shared_ptr<const typename SharedClass<A1>::ValueType>, std::monostate>;
 
-        inline const Locker<typename T::ValueType, T> lock_const(const SyncTimeoutType &timeout = SyncTimeoutDeedlock) const {
-            return make_auto(true, timeout);
-        }
+        typedef std::tuple<SnapshotType<A>...> SnapshotTuple;
 
-//        template < typename = std::enable_if<std::is_trivially_copyable_v < V >> >
-        inline T::ValueType & operator*() const {
-            auto guard_lock = lock_const();
-            return *guard_lock;
-        }
+        static constexpr size_t size = sizeof...(A);
 
-//        template < typename = std::enable_if<std::is_trivially_copyable_v < V >> >
-        inline Weak<T> & operator=(T::ValueType && value) {
-            auto guard_lock = lock();
-            *guard_lock = value;
-            return *this;
-        }
+        /*
+         * Deadlock avoidance in the same way as std::lock: wait only for one object without holding the others, 
+         * then try to capture the rest without waiting. If any of them is busy, release everything 
+         * and start again by waiting for the busy object. The timeout is common for the whole capture.
+         */
+        LockerAll(const SyncTimeoutType &timeout, A & ... args, const std::source_location &location = std::source_location::current())
+        : values(LockAllTraits<std::remove_const_t<A>>::shared(args)...) {
 
-        inline Weak<T> & set(T::ValueType && value, const SyncTimeoutType &timeout = SyncTimeoutDeedlock) {
-            auto guard_lock = lock(timeout);
-            *guard_lock = value;
-            return *this;
-        }
+            check_null(std::index_sequence_for<A...>{});
+            check_order(std::index_sequence_for<A...>{}, location);
 
-        inline explicit operator bool() const noexcept {
-            return this->lock();
+#ifdef MEMSAFE_LOCK_STATS
+            const uint64_t wait_start = LockStats::now();
+#endif
+            const auto deadline = std::chrono::steady_clock::now() + timeout;
+            size_t first = 0;
+            while (true) {
+                auto wait = std::chrono::duration_cast<SyncTimeoutType>(deadline - std::chrono::steady_clock::now());
+                if (!try_lock(std::index_sequence_for<A...>{}, first, std::max(wait, SyncTimeoutType(0)))) {
+#ifdef MEMSAFE_LOCK_STATS
+                    stats_timeout(std::index_sequence_for<A...>{}, first, wait_start, location);
+#endif
+                    throw memsafe_error("lock_all timeout");
+                }
+                size_t busy = size;
+                for (size_t pos = 0; pos < size; pos++) {
+                    if (pos != first && !try_lock(std::index_sequence_for<A...>{}, pos, SyncTimeoutType(0))) {
+                        busy = pos;
+                        break;
+                    }
+                }
+                if (busy == size) {
+                    break;
+                }
+                unlock(std::index_sequence_for<A...>{}, first, false);
+                for (size_t pos = 0; pos < busy; pos++) {
+                    if (pos != first) {
+                        unlock(std::index_sequence_for<A...>{}, pos, false);
+                    }
+                }
+                first = busy;
+                std::this_thread::yield();
+            }
+            push_order(std::index_sequence_for<A...>{}, location);
+#ifdef MEMSAFE_LOCK_STATS
+            stats_acquired(std::index_sequence_for<A...>{}, wait_start, location);
+#endif
+            pin_snapshots(std::index_sequence_for<A...>{});
         }
-    };
 
-    /**
-     * A class without a synchronization primitive and with the ability to work only in one application thread.   
-     * Used to control access to data from only one application thread without creating a synchronization object between threads.
-     */
-    template <typename V>
-    class SyncSingleThread : public Sync<V> {
-    public:
+        template <size_t I>
+        inline auto get() -> ValueRef<std::tuple_element_t<I, std::tuple < A...>>> {
+            if constexpr (snapshot<std::tuple_element_t<I, std::tuple < A...>>>) {
+                return *std::get<I>(snapshots);
+            } else {
+                return std::get<I>(values)->data;
+            }
+        }
 
-        SyncSingleThread(V v) : Sync<V>(v), m_thread_id(std::this_thread::get_id()) {
+        template <size_t I>
+        inline auto get() const -> const typename SharedClass<std::tuple_element_t<I, std::tuple < A...>>>::ValueType & {
+            if constexpr (snapshot<std::tuple_element_t<I, std::tuple < A...>>>) {
+                return *std::get<I>(snapshots);
+            } else {
+                return std::get<I>(values)->data;
+            }
         }
 
-    protected:
+        inline ~LockerAll() {
+            for (size_t pos = size; pos--;) {
+                unlock(std::index_sequence_for<A...>{}, pos, true);
+            }
+        }
 
-        const std::thread::id m_thread_id;
+    SCOPE(private) :
+        SharedTuple values;
+        SnapshotTuple snapshots;
 
-        inline void check_thread() {
-            if (m_thread_id != std::this_thread::get_id()) {
-                throw memsafe_error("Using a single thread variable in another thread!");
+        template <size_t ... I>
+        void check_null(std::index_sequence<I...>) {
+            if (((!std::get<I>(values)) || ...)) {
+                throw memsafe_error("Object missing (null pointer exception)");
             }
         }
 
-        inline bool try_lock(const SyncTimeoutType &timeout) override final {
-            check_thread();
-            Sync<V>::timeout_set_error(timeout);
-            return true;
-        }
+        template <typename A1>
+        static constexpr bool ordered = !snapshot<A1> && SyncLockOrdered<typename SharedClass<A1>::ValueType, typename SharedClass<A1>::DataType>;
 
-        inline void unlock() override final {
-            check_thread();
+        template <size_t ... I>
+        void pin_snapshots(std::index_sequence<I...>) {
+            ((snapshot<A> ? pin_snapshot<I>() : void()), ...);
         }
 
-        inline bool try_lock_const(const SyncTimeoutType &timeout) override final {
-            check_thread();
-            Sync<V>::timeout_set_error(timeout);
-            return true;
+        template <size_t I>
+        void pin_snapshot() {
+            if constexpr (snapshot<std::tuple_element_t<I, std::tuple < A...>>>) {
+                std::get<I>(snapshots) = std::get<I>(values)->snapshot();
+            }
         }
 
-        inline void unlock_const() override final {
-            check_thread();
+        template <size_t ... I>
+        void check_order(std::index_sequence<I...>, const std::source_location &location) {
+            ((ordered<A> ? LockOrder::check(static_cast<const Sync<typename SharedClass<A>::ValueType> *> (std::get<I>(values).get()), location) : true), ...);
         }
-    };
-
-    /**
-     * Class with timed mutex for simple multithreaded synchronization
-     */
 
-    template <typename V>
-    class SyncTimedMutex : public Sync<V>, protected std::timed_mutex {
-    public:
-
-        SyncTimedMutex(V v) : Sync<V>(v) {
+        template <size_t ... I>
+        void push_order(std::index_sequence<I...>, const std::source_location &location) {
+            ((ordered<A> ? LockOrder::push(static_cast<const Sync<typename SharedClass<A>::ValueType> *> (std::get<I>(values).get()), location) : void()), ...);
         }
 
-    protected:
+        // Objects counted by @ref LockStats the same way as by Shared::make_auto (the pinned snapshots are not locked)
+        template <typename A1>
+        static constexpr bool counted = !snapshot<A1> && !std::is_same_v<Sync<typename SharedClass<A1>::ValueType>, typename SharedClass<A1>::DataType>;
 
-        inline bool try_lock(const SyncTimeoutType &timeout) override final {
+#ifdef MEMSAFE_LOCK_STATS
 
-            return std::timed_mutex::try_lock_for(timeout);
+        template <size_t ... I>
+        void stats_acquired(std::index_sequence<I...>, uint64_t wait_start, const std::source_location &location) {
+            ((counted<A> ? LockStats::acquired(static_cast<const Sync<typename SharedClass<A>::ValueType> *> (std::get<I>(values).get()), true, wait_start, location) : void()), ...);
         }
 
-        inline void unlock() override final {
+        template <size_t ... I>
+        void stats_timeout(std::index_sequence<I...>, size_t pos, uint64_t wait_start, const std::source_location &location) {
+            ((I == pos && counted<A> ? LockStats::acquired(static_cast<const Sync<typename SharedClass<A>::ValueType> *> (std::get<I>(values).get()), false, wait_start, location) : void()), ...);
+        }
+#endif
 
-            std::timed_mutex::unlock();
+        template <typename V, typename D>
+        static inline bool try_lock_data(D &data, bool read_only, const SyncTimeoutType &timeout) {
+            // Policies without a synchronization object (Sync and SyncSingleThread) are never busy and do not accept a timeout
+            if constexpr (std::is_same_v<decltype(&D::TryLock), decltype(&Sync<V>::TryLock)> || std::is_base_of_v<SyncSingleThread<V>, D>) {
+                return data.TryLock(read_only);
+            } else {
+                return data.TryLock(read_only, timeout);
+            }
         }
 
-        inline bool try_lock_const(const SyncTimeoutType &timeout) override final {
+        template <size_t I>
+        inline bool try_lock_at(const SyncTimeoutType &timeout) {
+            typedef std::tuple_element_t<I, std::tuple < A...>> A1;
+            if constexpr (snapshot<A1>) { // The snapshot is pinned without lock
+                return true;
+            } else {
+                return try_lock_data<typename SharedClass<A1>::ValueType>(*std::get<I>(values), std::is_const_v<A1>, timeout);
+            }
+        }
 
-            return std::timed_mutex::try_lock_for(timeout);
+        /*
+         * The bookkeeping of the lock order and the counters is done only for the captured objects, 
+         * the objects released by the retry loop of the constructor were not registered yet 
+         * and their data was not changed (a @ref SyncRcu writer does not publish a snapshot).
+         */
+        template <size_t I>
+        inline void unlock_at(bool captured) {
+            typedef std::tuple_element_t<I, std::tuple < A...>> A1;
+            if constexpr (!snapshot<A1>) {
+                if (captured) {
+                    std::get<I>(values)->UnLock(std::is_const_v<A1>);
+                } else {
+                    std::get<I>(values)->UnLockUnchanged(std::is_const_v<A1>);
+                }
+                if constexpr (ordered<A1>) {
+                    if (captured) {
+                        LockOrder::release(static_cast<const Sync<typename SharedClass<A1>::ValueType> *> (std::get<I>(values).get()));
+                    }
+                }
+#ifdef MEMSAFE_LOCK_STATS
+                if constexpr (counted<A1>) {
+                    if (captured) {
+                        LockStats::released(static_cast<const Sync<typename SharedClass<A1>::ValueType> *> (std::get<I>(values).get()));
+                    }
+                }
+#endif
+            }
         }
 
-        inline void unlock_const() override final {
+        template <size_t ... I>
+        bool try_lock(std::index_sequence<I...>, size_t pos, const SyncTimeoutType &timeout) {
+            bool result = false;
+            ((I == pos ? (result = try_lock_at<I>(timeout), true) : false) || ...);
+            return result;
+        }
 
-            std::timed_mutex::unlock();
+        template <size_t ... I>
+        void unlock(std::index_sequence<I...>, size_t pos, bool captured) {
+            ((I == pos ? (unlock_at<I>(captured), true) : false) || ...);
         }
+
+        // Noncopyable
+        LockerAll(const LockerAll&) = delete;
+        LockerAll& operator=(const LockerAll&) = delete;
+        // Nonmovable
+        LockerAll(LockerAll&&) = delete;
+        LockerAll& operator=(LockerAll&&) = delete;
     };
 
     /**
-     * Class with shared_timed_mutex for multi-thread synchronization for exclusive read/write lock or shared read-only lock
+     * Capture several shared variables at once without the risk of a lock order deadlock.
+     * 
+     * Arguments passed as const (for example with std::as_const) are captured for read only access.
+     * 
+     * It is a class with deduction guides instead of a function, so that the source location 
+     * of the caller for @ref LockOrder and @ref LockStats can be a defaulted parameter after the arguments.
      */
 
-    template <typename V>
-    class SyncTimedShared : public Sync<V>, protected std::shared_timed_mutex {
+    template <LockAllArgument ... A> requires (sizeof...(A) > 0) // A statement `lock_all(var);` does not declare an empty capture
+    class lock_all : public LockerAll<A...> {
     public:
 
-        SyncTimedShared<V>(V v) : Sync<V>(v) {
-        }
-
-    protected:
-
-        inline bool try_lock(const SyncTimeoutType &timeout) override final {
-            return std::shared_timed_mutex::try_lock_for(timeout);
-        }
-
-        inline void unlock() override final {
-            std::shared_timed_mutex::unlock();
-        }
-
-        inline bool try_lock_const(const SyncTimeoutType &timeout) override final {
-            return std::shared_timed_mutex::try_lock_shared_for(timeout);
+        lock_all(const SyncTimeoutType &timeout, A & ... args, const std::source_location &location = std::source_location::current())
+        : LockerAll<A...>(timeout, args..., location) {
         }
 
-        inline void unlock_const() override final {
-            std::shared_timed_mutex::unlock_shared();
+        lock_all(A & ... args, const std::source_location &location = std::source_location::current())
+        : LockerAll<A...>(SyncTimeoutDeedlock, args..., location) {
         }
     };
 
+    template <LockAllArgument ... A> requires (sizeof...(A) > 0)
+    lock_all(const SyncTimeoutType &, A & ...) -> lock_all<A...>;
+
+    template <LockAllArgument ... A> requires (sizeof...(A) > 0)
+    lock_all(A & ...) -> lock_all<A...>;
+
+    // Synchronization policies are resolved at compile time without a table of virtual methods, 
+    // so the default shared data has no overhead compared to std::shared_ptr
+    static_assert(sizeof (Sync<int>) == sizeof (int));
+    static_assert(!std::is_polymorphic_v<Sync<int>>);
+    static_assert(!std::is_polymorphic_v<SyncSingleThread<int>>);
+    static_assert(!std::is_polymorphic_v<SyncTimedMutex<int>>);
+    static_assert(!std::is_polymorphic_v<SyncTimedShared<int>>);
+    static_assert(!std::is_polymorphic_v<SyncSeqLock<int>>);
+    static_assert(!std::is_polymorphic_v<SyncRcu<int>>);
+    static_assert(!std::is_polymorphic_v<SyncFutexMutex<int>>);
+    static_assert(!std::is_polymorphic_v<SyncSpinMutex<int>>);
+    static_assert(!std::is_polymorphic_v<SyncBiasedMutex<int>>);
+    static_assert(!std::is_polymorphic_v<SyncUpgradableShared<int>>);
+    static_assert(!std::is_polymorphic_v<SyncAsyncMutex<int>>);
+    static_assert(!std::is_polymorphic_v<SyncExecutor<int>>);
+    static_assert(sizeof (Padded<SyncTimedMutex>::Policy<int>) % SyncCacheLineSize == 0);
+    static_assert(sizeof (Shared<int>::DataType) == sizeof (int));
+    static_assert(sizeof (Shared<int>) == sizeof (std::shared_ptr<int>));
+    static_assert(sizeof (Shared<int, Intrusive<SyncTimedMutex>::Policy>) == sizeof (void *));
+    static_assert(sizeof (SyncAtomic<int>) == sizeof (int));
+
     /**
      * Class field reference variable (shared pointer) without multi-threaded access control
      * to store an object of the same class with protection against recursive references at runtime.
@@ -1063,6 +5122,9 @@ namespace memsafe { // Begin define memory safety classes
     MEMSAFE_SHARED_TYPE("memsafe::Shared");
 
     MEMSAFE_AUTO_TYPE("memsafe::Locker");
+    MEMSAFE_AUTO_TYPE("memsafe::LockerAll");
+    MEMSAFE_AUTO_TYPE("memsafe::UpgradableLocker");
+    MEMSAFE_AUTO_TYPE("memsafe::LockAwaiter");
     MEMSAFE_AUTO_TYPE("__gnu_cxx::__normal_iterator");
     MEMSAFE_AUTO_TYPE("std::reverse_iterator");
 
@@ -1088,5 +5150,24 @@ namespace memsafe { // Begin define memory safety classes
 
 } // namespace memsafe
 
+// Structured binding of the values captured by memsafe::lock_all
+
+template <typename ... A>
+struct std::tuple_size<memsafe::LockerAll<A...>> : std::integral_constant<size_t, sizeof...(A)> {
+};
+
+template <size_t I, typename ... A>
+struct std::tuple_element<I, memsafe::LockerAll<A...>> {
+    typedef std::remove_reference_t<typename memsafe::LockerAll<A...>::template ValueRef<std::tuple_element_t<I, std::tuple < A...>>>> type;
+};
+
+template <typename ... A>
+struct std::tuple_size<memsafe::lock_all<A...>> : std::tuple_size<memsafe::LockerAll<A...>> {
+};
+
+template <size_t I, typename ... A>
+struct std::tuple_element<I, memsafe::lock_all<A...>> : std::tuple_element<I, memsafe::LockerAll<A...>> {
+};
+
 
 #endif // INCLUDED_MEMSAFE_H_
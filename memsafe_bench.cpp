@@ -0,0 +1,555 @@
+/*
+ * Benchmarks of the memory safety library template classes.
+ *
+ * Build and run with: make bench
+ */
+
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <array>
+#include <deque>
+#include <malloc.h>
+#include <memory_resource>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "memsafe.h"
+
+using namespace memsafe;
+
+/*
+ * The default Shared<V> without access control must have the same size of data
+ * and the same cost of dereferencing as std::shared_ptr
+ */
+
+static_assert(sizeof (Shared<int>::DataType) == sizeof (int));
+static_assert(sizeof (Shared<int>) == sizeof (std::shared_ptr<int>));
+
+static void SharedPtrDeref(benchmark::State& state) {
+    std::shared_ptr<int> ptr = std::make_shared<int>(0);
+    for (auto _ : state) {
+        *ptr += 1;
+        benchmark::DoNotOptimize(*ptr);
+    }
+}
+BENCHMARK(SharedPtrDeref);
+
+static void SharedPtrCopyDeref(benchmark::State& state) {
+    // The same semantics as Locker: a temporary strong reference for the duration of access
+    std::shared_ptr<int> ptr = std::make_shared<int>(0);
+    for (auto _ : state) {
+        std::shared_ptr<int> temp = ptr;
+        *temp += 1;
+        benchmark::DoNotOptimize(*temp);
+    }
+}
+BENCHMARK(SharedPtrCopyDeref);
+
+static void SharedDeref(benchmark::State& state) {
+    Shared<int> shared(0);
+    for (auto _ : state) {
+        *shared += 1;
+        benchmark::DoNotOptimize(*shared);
+    }
+}
+BENCHMARK(SharedDeref);
+
+static void SharedLockDeref(benchmark::State& state) {
+    Shared<int> shared(0);
+    for (auto _ : state) {
+        auto guard = shared.lock();
+        *guard += 1;
+        benchmark::DoNotOptimize(*guard);
+    }
+}
+BENCHMARK(SharedLockDeref);
+
+template <template <typename> typename S>
+static void SharedPolicyLock(benchmark::State& state) {
+    Shared<int, S> shared(0);
+    for (auto _ : state) {
+        auto guard = shared.lock();
+        *guard += 1;
+        benchmark::DoNotOptimize(*guard);
+    }
+}
+BENCHMARK(SharedPolicyLock<Sync>);
+BENCHMARK(SharedPolicyLock<SyncSingleThread>);
+BENCHMARK(SharedPolicyLock<SyncTimedMutex>);
+BENCHMARK(SharedPolicyLock<SyncTimedShared>);
+
+/*
+ * Copy-heavy code: atomic reference counter of std::shared_ptr against the non-atomic counter of SyncSingleThread
+ */
+
+// libstdc++ uses non-atomic counters of std::shared_ptr until the first thread is created
+static void MultiThreaded() {
+    static std::once_flag once;
+    std::call_once(once, []() {
+        std::thread([]() {
+        }).join();
+    });
+}
+
+template <template <typename> typename S>
+static void SharedCopy(benchmark::State& state) {
+    MultiThreaded();
+    Shared<int, S> shared(0);
+    for (auto _ : state) {
+        Shared<int, S> copy(shared);
+        benchmark::DoNotOptimize(copy);
+    }
+}
+BENCHMARK(SharedCopy<SyncTimedMutex>);
+BENCHMARK(SharedCopy<SyncSingleThread>);
+
+template <template <typename> typename S>
+static void WeakCopyLock(benchmark::State& state) {
+    MultiThreaded();
+    Shared<int, S> shared(0);
+    Weak<Shared<int, S>> weak(shared);
+    for (auto _ : state) {
+        Weak<Shared<int, S>> copy(weak);
+        auto guard = copy.lock();
+        benchmark::DoNotOptimize(*guard);
+    }
+}
+BENCHMARK(WeakCopyLock<Sync>);
+BENCHMARK(WeakCopyLock<SyncSingleThread>);
+
+/*
+ * Many small objects: memory per object (handle and heap block) and dereferencing in random order
+ * of std::shared_ptr with the control block against intrusive reference counters
+ */
+
+typedef std::array<uint64_t, 2> SmallNode;
+
+template <template <typename> typename S>
+static void SmallNodes(benchmark::State& state) {
+    MultiThreaded();
+    const size_t count = state.range(0);
+    const size_t heap = mallinfo2().uordblks;
+    std::deque<Shared<SmallNode, S>> nodes;
+    for (size_t i = 0; i < count; i++) {
+        nodes.emplace_back(SmallNode{i, i});
+    }
+    state.counters["bytes_per_object"] = static_cast<double> (mallinfo2().uordblks - heap) / count;
+
+    std::vector<uint32_t> order(count);
+    for (size_t i = 0; i < count; i++) {
+        order[i] = (i * 2654435761U) % count;
+    }
+    for (auto _ : state) {
+        uint64_t sum = 0;
+        for (uint32_t index : order) {
+            sum += (*nodes[index])[0];
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(SmallNodes<Sync>)->Arg(1 << 20);
+BENCHMARK(SmallNodes<Intrusive<Sync>::Policy>)->Arg(1 << 20);
+
+/*
+ * Weak pointers: the validity check without capturing the data and the capture with a single promotion
+ */
+
+static void WeakValid(benchmark::State& state) {
+    Shared<int, SyncTimedMutex> shared(0);
+    Weak<Shared<int, SyncTimedMutex>> weak(shared);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(static_cast<bool> (weak));
+    }
+}
+BENCHMARK(WeakValid);
+
+static void WeakLock(benchmark::State& state) {
+    Shared<int, SyncFutexMutex> shared(0);
+    Weak<Shared<int, SyncFutexMutex>> weak(shared);
+    for (auto _ : state) {
+        auto guard = weak.lock();
+        benchmark::DoNotOptimize(*guard);
+    }
+}
+BENCHMARK(WeakLock);
+
+/*
+ * Uncontended lock and unlock latency of timed mutex policies
+ */
+
+template <template <typename> typename S>
+static void UncontendedLock(benchmark::State& state) {
+    Shared<int, S> shared(0);
+    for (auto _ : state) {
+        auto guard = shared.lock();
+        benchmark::DoNotOptimize(*guard);
+    }
+}
+BENCHMARK(UncontendedLock<SyncTimedMutex>);
+BENCHMARK(UncontendedLock<SyncTimedShared>);
+BENCHMARK(UncontendedLock<SyncFutexMutex>);
+BENCHMARK(UncontendedLock<SyncSpinMutex>);
+BENCHMARK(UncontendedLock<SyncBiasedMutex>);
+
+#ifdef MEMSAFE_LOCK_TRACE
+
+/*
+ * Cost of the trace events of one lock (acquisition and release), build with -DMEMSAFE_LOCK_TRACE: 
+ * batches of the same locks with the trace disabled and enabled alternate, 
+ * the counter delta_ns is the traced minus the untraced time of one lock
+ */
+
+static void TracedLock(benchmark::State& state) {
+    constexpr int batch = 1000;
+    Shared<int, SyncFutexMutex> shared(0);
+    auto run = [&shared]() {
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < batch; i++) {
+            auto guard = shared.lock();
+            benchmark::DoNotOptimize(*guard);
+        }
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    };
+    double untraced = 0;
+    double traced = 0;
+    for (auto _ : state) {
+        untraced += run();
+        LockTrace::enable();
+        const double time = run();
+        LockTrace::disable();
+        traced += time;
+        state.SetIterationTime(time / 1e9);
+    }
+    const double locks = static_cast<double> (state.iterations()) * batch;
+    state.counters["untraced_ns"] = untraced / locks;
+    state.counters["traced_ns"] = traced / locks;
+    state.counters["delta_ns"] = (traced - untraced) / locks;
+}
+BENCHMARK(TracedLock)->UseManualTime();
+
+#endif
+
+/*
+ * Timeout path under overload: exception with a formatted message against the error code of try_lock
+ */
+
+static void TimeoutThrow(benchmark::State& state) {
+    Shared<int, SyncFutexMutex> shared(0);
+    auto guard = shared.lock();
+    for (auto _ : state) {
+        try {
+            auto busy = shared.lock(SyncTimeoutType(0));
+            benchmark::DoNotOptimize(*busy);
+        } catch (memsafe_error &err) {
+            benchmark::DoNotOptimize(err);
+        }
+    }
+}
+BENCHMARK(TimeoutThrow);
+
+static void TimeoutTryLock(benchmark::State& state) {
+    Shared<int, SyncFutexMutex> shared(0);
+    auto guard = shared.lock();
+    for (auto _ : state) {
+        auto busy = shared.try_lock(SyncTimeoutType(0));
+        benchmark::DoNotOptimize(busy);
+    }
+}
+BENCHMARK(TimeoutTryLock);
+
+/*
+ * Request scoped variables: the global heap against a request arena released at once
+ */
+
+static void RequestHeap(benchmark::State& state) {
+    for (auto _ : state) {
+        std::deque<Shared<uint64_t, SyncFutexMutex>> request;
+        for (int64_t i = 0; i < state.range(0); i++) {
+            request.emplace_back(i);
+        }
+        benchmark::DoNotOptimize(request);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(RequestHeap)->Arg(1000);
+
+static void RequestArena(benchmark::State& state) {
+    std::pmr::monotonic_buffer_resource arena;
+    for (auto _ : state) {
+        {
+            std::pmr::deque<Shared<uint64_t, SyncFutexMutex>> request(&arena);
+            for (int64_t i = 0; i < state.range(0); i++) {
+                request.emplace_back(std::allocator_arg, std::pmr::polymorphic_allocator<>(&arena), i);
+            }
+            benchmark::DoNotOptimize(request);
+        }
+        arena.release();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(RequestArena)->Arg(1000);
+
+/*
+ * Overhead of the lock order graph for nested locks: disabled, every acquisition checked and sampled
+ */
+
+static void NestedLockOrder(benchmark::State& state) {
+    Shared<int, SyncFutexMutex> outer(0);
+    Shared<int, SyncFutexMutex> inner(0);
+    if (state.range(0)) {
+        LockOrder::enable(state.range(0));
+    }
+    for (auto _ : state) {
+        auto guard_outer = outer.lock();
+        auto guard_inner = inner.lock();
+        benchmark::DoNotOptimize(*guard_inner);
+    }
+    LockOrder::disable();
+    LockOrder::clear();
+}
+BENCHMARK(NestedLockOrder)->Arg(0)->Arg(1)->Arg(64);
+
+/*
+ * Parallel access of threads to their own adjacent shared variables with and without cache-line padding
+ */
+
+template <template <typename> typename S>
+static void AdjacentObjects(benchmark::State& state) {
+    static std::deque<Shared<uint64_t, S>> objects = []() {
+        std::deque<Shared<uint64_t, S>> result;
+        for (size_t i = 0; i < 64; i++) {
+            result.emplace_back(0);
+        }
+        return result;
+    }();
+    Shared<uint64_t, S> & shared = objects[state.thread_index() % objects.size()];
+    for (auto _ : state) {
+        *shared.lock() += 1;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(AdjacentObjects<SyncFutexMutex>)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK(AdjacentObjects<Padded<SyncFutexMutex>::Policy>)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK(AdjacentObjects<SyncTimedMutex>)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK(AdjacentObjects<Padded<SyncTimedMutex>::Policy>)->ThreadRange(1, 16)->UseRealTime();
+
+/*
+ * Concurrent readers: the lock mode is carried by the Locker type, so read only access 
+ * writes nothing to the shared object except the mutex and the reference counter.
+ * SyncModeInObject stores the mode in the shared object on every lock and reads it on unlock 
+ * as before that change, compare both at the same number of threads on a multi-core machine 
+ * (on a single core the threads do not run in parallel and both are the same)
+ */
+
+template <typename V>
+class SyncModeInObject : public SyncTimedShared<V> {
+public:
+
+    template <typename ... Args>
+    SyncModeInObject(Args && ... args) : SyncTimedShared<V>(std::forward<Args>(args)...) {
+    }
+
+    [[nodiscard]]
+    inline bool TryLock(bool const_lock, const SyncTimeoutType &timeout = SyncTimeoutDeedlock) {
+        m_const_lock.store(const_lock, std::memory_order_relaxed);
+        return SyncTimedShared<V>::TryLock(const_lock, timeout);
+    }
+
+    inline void UnLock(bool) {
+        SyncTimedShared<V>::UnLock(m_const_lock.load(std::memory_order_relaxed));
+    }
+
+protected:
+    std::atomic<bool> m_const_lock = false;
+};
+
+template <template <typename> typename S>
+static void SharedReaders(benchmark::State& state) {
+    static Shared<int, S> shared(0);
+    for (auto _ : state) {
+        auto guard = shared.lock_const();
+        benchmark::DoNotOptimize(*guard);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(SharedReaders<SyncTimedShared>)->ThreadRange(1, 64)->UseRealTime();
+BENCHMARK(SharedReaders<SyncModeInObject>)->ThreadRange(1, 64)->UseRealTime();
+
+/*
+ * "Check, then modify": read lock, release and exclusive lock with a re-check against the upgradable read lock
+ */
+
+static void CheckModifyRelock(benchmark::State& state) {
+    static Shared<uint64_t, SyncTimedShared> shared(0);
+    for (auto _ : state) {
+        if (*shared.lock_const() != UINT64_MAX) {
+            auto writer = shared.lock();
+            if (*writer != UINT64_MAX) { // The value may have changed after releasing the read lock
+                *writer += 1;
+            }
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(CheckModifyRelock)->ThreadRange(1, 8)->UseRealTime();
+
+static void CheckModifyUpgradable(benchmark::State& state) {
+    static Shared<uint64_t, SyncUpgradableShared> shared(0);
+    for (auto _ : state) {
+        auto guard = shared.lock_upgradable();
+        if (*guard != UINT64_MAX) {
+            auto writer = guard.upgrade();
+            *writer += 1;
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(CheckModifyUpgradable)->ThreadRange(1, 8)->UseRealTime();
+
+/*
+ * Statistics aggregation: a read lock for each field against one read lock for the batch of fields
+ */
+
+struct Stats {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+};
+
+static void StatsPerField(benchmark::State& state) {
+    static Shared<Stats, SyncTimedShared> shared(Stats{1, 2, 3, 4});
+    for (auto _ : state) {
+        uint64_t total = (*shared).count + (*shared).sum + (*shared).min + (*shared).max;
+        benchmark::DoNotOptimize(total);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(StatsPerField)->ThreadRange(1, 8)->UseRealTime();
+
+static void StatsBatched(benchmark::State& state) {
+    static Shared<Stats, SyncTimedShared> shared(Stats{1, 2, 3, 4});
+    for (auto _ : state) {
+        auto [count, sum, min, max] = shared.load(&Stats::count, &Stats::sum, &Stats::min, &Stats::max);
+        uint64_t total = count + sum + min + max;
+        benchmark::DoNotOptimize(total);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(StatsBatched)->ThreadRange(1, 8)->UseRealTime();
+
+/*
+ * Counters and flags: a lock-free atomic operation instead of a timed mutex round-trip
+ */
+
+static void SharedCounterMutex(benchmark::State& state) {
+    static Shared<uint64_t, SyncTimedMutex> shared(0);
+    for (auto _ : state) {
+        *shared.lock() += 1;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(SharedCounterMutex)->ThreadRange(1, 8)->UseRealTime();
+
+static void SharedCounterFutex(benchmark::State& state) {
+    static Shared<uint64_t, SyncFutexMutex> shared(0);
+    for (auto _ : state) {
+        *shared.lock() += 1;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(SharedCounterFutex)->ThreadRange(1, 8)->UseRealTime();
+
+static void SharedCounterSpin(benchmark::State& state) {
+    static Shared<uint64_t, SyncSpinMutex> shared(0);
+    for (auto _ : state) {
+        *shared.lock() += 1;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(SharedCounterSpin)->ThreadRange(1, 8)->UseRealTime();
+
+static void SharedCounterAtomic(benchmark::State& state) {
+    static Shared<uint64_t, SyncAtomic> shared(0);
+    for (auto _ : state) {
+        shared.fetch_add(1);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(SharedCounterAtomic)->ThreadRange(1, 8)->UseRealTime();
+
+/*
+ * Read-mostly data: optimistic readers of the sequence lock against a shared read lock
+ */
+
+typedef std::array<uint64_t, 8> Snapshot;
+
+static void SnapshotReadersShared(benchmark::State& state) {
+    static Shared<Snapshot, SyncTimedShared> shared(Snapshot{});
+    for (auto _ : state) {
+        Snapshot copy = *shared.lock_const();
+        benchmark::DoNotOptimize(copy);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(SnapshotReadersShared)->ThreadRange(1, 64)->UseRealTime();
+
+static void SnapshotReadersSeqLock(benchmark::State& state) {
+    static Shared<Snapshot, SyncSeqLock> shared(Snapshot{});
+    for (auto _ : state) {
+        Snapshot copy = shared.load();
+        benchmark::DoNotOptimize(copy);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(SnapshotReadersSeqLock)->ThreadRange(1, 64)->UseRealTime();
+
+static void SnapshotReadersRcu(benchmark::State& state) {
+    static Shared<Snapshot, SyncRcu> shared(Snapshot{});
+    for (auto _ : state) {
+        auto snapshot = shared.lock_const();
+        benchmark::DoNotOptimize(*snapshot);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(SnapshotReadersRcu)->ThreadRange(1, 64)->UseRealTime();
+
+/*
+ * High contention: delegation of the closures to the worker thread owning the data (waiting for each result or for every 64th) 
+ * against every thread taking the timed mutex in SharedCounterMutex
+ */
+
+static void ContendedExecutorWait(benchmark::State& state) {
+    static Shared<uint64_t, SyncExecutor> shared(0);
+    for (auto _ : state) {
+        shared.submit([](uint64_t & value) {
+            value += 1;
+        }).get();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(ContendedExecutorWait)->ThreadRange(1, 8)->UseRealTime();
+
+static void ContendedExecutorBatch(benchmark::State& state) {
+    static Shared<uint64_t, SyncExecutor> shared(0);
+    std::future<void> last;
+    size_t count = 0;
+    for (auto _ : state) {
+        last = shared.submit([](uint64_t & value) {
+            value += 1;
+        });
+        if (++count % 64 == 0) {
+            last.get();
+        }
+    }
+    if (last.valid()) {
+        last.get();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(ContendedExecutorBatch)->ThreadRange(1, 8)->UseRealTime();
+
+BENCHMARK_MAIN();
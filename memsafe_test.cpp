@@ -7,6 +7,8 @@
 #include <sstream>
 #include <filesystem>
 #include <chrono>
+#include <deque>
+#include <coroutine>
 
 #include "memsafe.h"
 #include "memsafe_plugin.h"
@@ -89,35 +91,35 @@ TEST(MemSafe, Sizes) {
     EXPECT_EQ(16, sizeof (TestClass4));
 
 
-    EXPECT_EQ(16, sizeof (Sync<int>));
-    EXPECT_EQ(24, sizeof (SyncSingleThread<int>));
-    EXPECT_EQ(56, sizeof (SyncTimedMutex<int>));
-    EXPECT_EQ(72, sizeof (SyncTimedShared<int>));
+    EXPECT_EQ(4, sizeof (Sync<int>));
+    EXPECT_EQ(16, sizeof (SyncSingleThread<int>));
+    EXPECT_EQ(48, sizeof (SyncTimedMutex<int>));
+    EXPECT_EQ(64, sizeof (SyncTimedShared<int>));
 
-    EXPECT_EQ(16, sizeof (Sync<uint8_t>));
-    EXPECT_EQ(24, sizeof (SyncSingleThread<uint8_t>));
-    EXPECT_EQ(56, sizeof (SyncTimedMutex<uint8_t>));
-    EXPECT_EQ(72, sizeof (SyncTimedShared<uint8_t>));
+    EXPECT_EQ(1, sizeof (Sync<uint8_t>));
+    EXPECT_EQ(16, sizeof (SyncSingleThread<uint8_t>));
+    EXPECT_EQ(48, sizeof (SyncTimedMutex<uint8_t>));
+    EXPECT_EQ(64, sizeof (SyncTimedShared<uint8_t>));
 
-    EXPECT_EQ(24, sizeof (Sync<uint64_t>));
-    EXPECT_EQ(32, sizeof (SyncSingleThread<uint64_t>));
-    EXPECT_EQ(64, sizeof (SyncTimedMutex<uint64_t>));
-    EXPECT_EQ(80, sizeof (SyncTimedShared<uint64_t>));
+    EXPECT_EQ(8, sizeof (Sync<uint64_t>));
+    EXPECT_EQ(16, sizeof (SyncSingleThread<uint64_t>));
+    EXPECT_EQ(48, sizeof (SyncTimedMutex<uint64_t>));
+    EXPECT_EQ(64, sizeof (SyncTimedShared<uint64_t>));
 
     EXPECT_EQ(99, sizeof (std::array<uint8_t, 99 >));
     EXPECT_EQ(100, sizeof (std::array<uint8_t, 100 >));
     EXPECT_EQ(101, sizeof (std::array<uint8_t, 101 >));
 
-    EXPECT_EQ(112, sizeof (Sync<std::array<uint8_t, 100 >>));
-    EXPECT_EQ(120, sizeof (SyncSingleThread<std::array<uint8_t, 100 >>));
-    EXPECT_EQ(152, sizeof (SyncTimedMutex<std::array <uint8_t, 100 >>));
-    EXPECT_EQ(168, sizeof (SyncTimedShared<std::array<uint8_t, 100 >>));
+    EXPECT_EQ(100, sizeof (Sync<std::array<uint8_t, 100 >>));
+    EXPECT_EQ(112, sizeof (SyncSingleThread<std::array<uint8_t, 100 >>));
+    EXPECT_EQ(144, sizeof (SyncTimedMutex<std::array <uint8_t, 100 >>));
+    EXPECT_EQ(160, sizeof (SyncTimedShared<std::array<uint8_t, 100 >>));
 
     EXPECT_EQ(101, sizeof (std::array<uint8_t, 101 >));
-    EXPECT_EQ(112, sizeof (Sync<std::array<uint8_t, 101 >>));
-    EXPECT_EQ(120, sizeof (SyncSingleThread<std::array<uint8_t, 101 >>));
-    EXPECT_EQ(152, sizeof (SyncTimedMutex<std::array <uint8_t, 101 >>));
-    EXPECT_EQ(168, sizeof (SyncTimedShared<std::array<uint8_t, 101 >>));
+    EXPECT_EQ(101, sizeof (Sync<std::array<uint8_t, 101 >>));
+    EXPECT_EQ(112, sizeof (SyncSingleThread<std::array<uint8_t, 101 >>));
+    EXPECT_EQ(144, sizeof (SyncTimedMutex<std::array <uint8_t, 101 >>));
+    EXPECT_EQ(160, sizeof (SyncTimedShared<std::array<uint8_t, 101 >>));
 
 
     EXPECT_EQ(16, sizeof (Shared<int>));
@@ -432,6 +434,1908 @@ TEST(MemSafe, Threads) {
 
 }
 
+TEST(MemSafe, LockMode) {
+
+    static_assert(std::is_same_v<Locker<int, Shared<int, SyncTimedShared>::SharedType>, decltype(std::declval<Shared<int, SyncTimedShared>>().lock())>);
+    static_assert(std::is_same_v<Locker<int, Shared<int, SyncTimedShared>::SharedType, true>, decltype(std::declval<Shared<int, SyncTimedShared>>().lock_const())>);
+
+    memsafe::Shared<int, SyncTimedShared> var_shared(0);
+    memsafe::Weak<Shared<int, SyncTimedShared>> var_weak(var_shared.weak());
+
+    {
+        auto reader = var_shared.lock_const();
+        bool catched = false;
+
+        std::thread write([&]() {
+            try {
+                // The failed write attempt must not change the lock mode of the current reader
+                auto writer = var_shared.lock(10ms);
+            } catch (...) {
+                catched = true;
+            }
+        });
+        write.join();
+        ASSERT_TRUE(catched);
+
+        auto reader2 = var_weak.lock_const();
+        ASSERT_EQ(0, *reader2);
+    }
+
+    std::thread write([&]() {
+        auto writer = var_weak.lock(10ms);
+        *writer = 1;
+    });
+    write.join();
+
+    ASSERT_EQ(1, *var_shared.lock_const());
+}
+
+TEST(MemSafe, Atomic) {
+
+    EXPECT_EQ(16, sizeof (Shared<int, SyncAtomic>));
+    EXPECT_EQ(4, sizeof (SyncAtomic<int>));
+    EXPECT_EQ(8, sizeof (SyncAtomic<uint64_t>));
+
+    memsafe::Shared<uint64_t, SyncAtomic> var_atomic(0);
+    memsafe::Weak<Shared<uint64_t, SyncAtomic>> var_weak(var_atomic.weak());
+
+    std::thread t1([&]() {
+        for (auto i = 0; i < 1'000'000; ++i)
+            var_atomic.fetch_add(1);
+    });
+    std::thread t2([&]() {
+        for (auto i = 0; i < 1'000'000; ++i)
+            var_weak.fetch_add(1);
+    });
+    t1.join();
+    t2.join();
+
+    EXPECT_EQ(2'000'000, var_atomic.load());
+    EXPECT_EQ(2'000'000, var_weak.load());
+
+    var_weak.store(10);
+    EXPECT_EQ(10, var_atomic.exchange(20));
+    EXPECT_EQ(20, var_atomic.fetch_sub(5));
+    EXPECT_EQ(15, var_atomic.fetch_or(16));
+    EXPECT_EQ(31, var_atomic.fetch_and(7));
+    EXPECT_EQ(7, var_weak.fetch_xor(1));
+
+    uint64_t expected = 0;
+    EXPECT_FALSE(var_atomic.compare_exchange(expected, 100));
+    EXPECT_EQ(6, expected);
+    EXPECT_TRUE(var_weak.compare_exchange(expected, 100));
+    EXPECT_EQ(100, var_atomic.load());
+
+    memsafe::Shared<uint64_t, SyncAtomic> var_null;
+    ASSERT_ANY_THROW(var_null.load());
+
+    var_atomic = var_null;
+    ASSERT_ANY_THROW(var_weak.load());
+}
+
+TEST(MemSafe, SeqLock) {
+
+    struct Pair {
+        int64_t first;
+        int64_t second; // Always equal to -first
+    };
+
+    memsafe::Shared<Pair, SyncSeqLock> var_seq(Pair{0, 0});
+    memsafe::Weak<Shared<Pair, SyncSeqLock>> var_weak(var_seq.weak());
+
+    std::atomic<bool> done(false);
+    std::atomic<size_t> broken(0);
+
+    std::thread reader([&]() {
+        while (!done) {
+            Pair value = var_weak.load();
+            if (value.first != -value.second) {
+                broken++;
+            }
+        }
+    });
+
+    for (int64_t i = 1; i <= 100'000; i++) {
+        auto writer = var_seq.lock();
+        (*writer).first = i;
+        (*writer).second = -i;
+    }
+    done = true;
+    reader.join();
+
+    EXPECT_EQ(0, broken);
+    EXPECT_EQ(100'000, var_seq.load().first);
+    EXPECT_EQ(-100'000, (*var_seq.lock_const()).second);
+}
+
+TEST(MemSafe, Rcu) {
+
+    typedef std::map<std::string, int> Config;
+
+    memsafe::Shared<Config, SyncRcu> var_rcu(Config{{"value", 0}});
+    memsafe::Weak<Shared<Config, SyncRcu>> var_weak(var_rcu.weak());
+
+    static_assert(std::is_same_v<const Config&, decltype(*var_rcu.lock_const())>);
+
+    {
+        auto snapshot = var_rcu.lock_const();
+        ASSERT_EQ(0, (*snapshot).at("value"));
+        {
+            auto writer = var_rcu.lock();
+            (*writer)["value"] = 1;
+            (*writer)["other"] = 2;
+            // Not published until the writer is released
+            ASSERT_EQ(0, (*var_weak.lock_const()).at("value"));
+        }
+        // The reader keeps the pinned snapshot
+        ASSERT_EQ(0, (*snapshot).at("value"));
+        ASSERT_EQ(1, (*snapshot).size());
+
+        ASSERT_EQ(1, (*var_weak.lock_const()).at("value"));
+        ASSERT_EQ(2, (*var_rcu.lock_const()).at("other"));
+    }
+
+    // The published data is copied, the working data remains valid
+    ASSERT_EQ(1, var_rcu.get()->data.at("value"));
+
+    // The writer interrupted by an exception does not publish the half-modified data
+    auto aborted = [&]() {
+        auto writer = var_rcu.lock();
+        (*writer)["value"] = 100;
+        throw std::runtime_error("aborted");
+    };
+    ASSERT_THROW(aborted(), std::runtime_error);
+    ASSERT_EQ(1, (*var_rcu.lock_const()).at("value"));
+    ASSERT_EQ(1, (*var_rcu.lock()).at("value"));
+
+    std::atomic<bool> done(false);
+    std::atomic<size_t> broken(0);
+
+    // The reader starts with the snapshot that satisfies the checked invariant
+    *var_rcu.lock() = Config{{"value", 0}, {"other", 0}};
+
+    std::thread reader([&]() {
+        while (!done) {
+            auto snapshot = var_weak.lock_const();
+            if ((*snapshot).at("value") != -(*snapshot).at("other")) {
+                broken++;
+            }
+        }
+    });
+
+    for (int i = 1; i <= 1'000; i++) {
+        auto writer = var_rcu.lock();
+        (*writer)["value"] = i;
+        (*writer)["other"] = -i;
+    }
+    done = true;
+    reader.join();
+
+    EXPECT_EQ(0, broken);
+    EXPECT_EQ(1'000, (*var_rcu.lock_const()).at("value"));
+}
+
+TEST(MemSafe, Futex) {
+
+    EXPECT_EQ(8, sizeof (SyncFutexMutex<int>));
+
+    memsafe::Shared<int, SyncFutexMutex> var_futex(0);
+    memsafe::Weak<Shared<int, SyncFutexMutex>> var_weak(var_futex.weak());
+
+    std::thread t1([&]() {
+        for (auto i = 0; i < 100'000; ++i)
+            *var_futex.lock() += 1;
+    });
+    std::thread t2([&]() {
+        for (auto i = 0; i < 100'000; ++i)
+            *var_weak.lock() += 1;
+    });
+    t1.join();
+    t2.join();
+
+    EXPECT_EQ(200'000, *var_futex.lock_const());
+
+    bool catched = false;
+    std::chrono::duration<double, std::milli> elapsed;
+    {
+        auto guard = var_futex.lock();
+
+        std::thread other([&]() {
+            const auto start = std::chrono::steady_clock::now();
+            try {
+                var_weak.lock(50ms);
+            } catch (...) {
+                catched = true;
+            }
+            elapsed = std::chrono::steady_clock::now() - start;
+        });
+        other.join();
+    }
+
+    ASSERT_TRUE(catched);
+    ASSERT_TRUE(elapsed >= 50.0ms);
+    ASSERT_TRUE(elapsed < 1000.0ms);
+
+    ASSERT_NO_THROW(var_weak.lock(50ms));
+}
+
+struct SpinNoBudget {
+    int value;
+};
+
+template <>
+struct memsafe::SyncSpinTraits<SpinNoBudget> {
+    static constexpr size_t spin_count = 0;
+};
+
+TEST(MemSafe, Spin) {
+
+    static_assert(1024 == SyncSpinTraits<int>::spin_count);
+    static_assert(0 == SyncSpinTraits<SpinNoBudget>::spin_count);
+
+    memsafe::Shared<int, SyncSpinMutex> var_spin(0);
+    memsafe::Shared<SpinNoBudget, SyncSpinMutex> var_park(SpinNoBudget{0});
+
+    std::thread t1([&]() {
+        for (auto i = 0; i < 100'000; ++i) {
+            *var_spin.lock() += 1;
+            (*var_park.lock()).value += 1;
+        }
+    });
+    std::thread t2([&]() {
+        for (auto i = 0; i < 100'000; ++i) {
+            *var_spin.lock() += 1;
+            (*var_park.lock()).value += 1;
+        }
+    });
+    t1.join();
+    t2.join();
+
+    EXPECT_EQ(200'000, *var_spin.lock_const());
+    EXPECT_EQ(200'000, (*var_park.lock_const()).value);
+
+    bool catched = false;
+    {
+        auto guard = var_spin.lock();
+
+        std::thread other([&]() {
+            try {
+                var_spin.lock(10ms);
+            } catch (...) {
+                catched = true;
+            }
+        });
+        other.join();
+    }
+    ASSERT_TRUE(catched);
+    ASSERT_NO_THROW(var_spin.lock(10ms));
+}
+
+TEST(MemSafe, Biased) {
+
+    memsafe::Shared<int, SyncBiasedMutex> var_biased(0);
+    memsafe::Weak<Shared<int, SyncBiasedMutex>> var_weak(var_biased.weak());
+
+    for (auto i = 0; i < 100'000; ++i) {
+        *var_biased.lock() += 1;
+    }
+    ASSERT_TRUE(var_biased->is_biased());
+
+    {
+        // Recursive capture in the owner thread
+        auto guard = var_biased.lock();
+        ASSERT_ANY_THROW(var_biased.lock_const());
+
+        // Revocation waits for the owner to leave the critical section
+        bool catched = false;
+        std::thread other([&]() {
+            try {
+                var_weak.lock(10ms);
+            } catch (...) {
+                catched = true;
+            }
+        });
+        other.join();
+        ASSERT_TRUE(catched);
+    }
+    ASSERT_FALSE(var_biased->is_biased());
+
+    std::thread t1([&]() {
+        for (auto i = 0; i < 100'000; ++i)
+            *var_weak.lock() += 1;
+    });
+    for (auto i = 0; i < 100'000; ++i) {
+        *var_biased.lock() += 1;
+    }
+    t1.join();
+
+    EXPECT_EQ(300'000, *var_biased.lock_const());
+}
+
+TEST(MemSafe, Padded) {
+
+    EXPECT_EQ(64, SyncCacheLineSize);
+    EXPECT_EQ(64, sizeof (Padded<Sync>::Policy<int>));
+    EXPECT_EQ(64, sizeof (Padded<SyncTimedMutex>::Policy<int>));
+    EXPECT_EQ(64, sizeof (Padded<SyncTimedShared>::Policy<uint64_t>));
+    EXPECT_EQ(192, sizeof (Padded<SyncTimedShared>::Policy<std::array<uint8_t, 101>>));
+    EXPECT_EQ(16, sizeof (Shared<int, Padded<SyncTimedMutex>::Policy>));
+
+    std::deque<memsafe::Shared<int, Padded<SyncFutexMutex>::Policy>> vars;
+    for (auto i = 0; i < 10; i++) {
+        vars.emplace_back(i);
+        ASSERT_EQ(0, reinterpret_cast<uintptr_t> (vars.back().get()) % SyncCacheLineSize);
+        ASSERT_EQ(i, *vars.back().lock());
+    }
+
+    memsafe::Shared<int, Padded<SyncRcu>::Policy> var_rcu(1);
+    *var_rcu.lock() = 2;
+    static_assert(std::is_same_v<const int&, decltype(*var_rcu.lock_const())>);
+    ASSERT_EQ(2, *var_rcu.lock_const());
+
+    memsafe::Shared<int, Padded<SyncAtomic>::Policy> var_atomic(1);
+    ASSERT_EQ(1, var_atomic.fetch_add(1));
+    ASSERT_EQ(2, var_atomic.load());
+}
+
+static size_t lock_order_reports = 0;
+
+static void lock_nested(std::vector<memsafe::Shared<int, SyncTimedMutex>> &vars, size_t pos) {
+    if (pos < vars.size()) {
+        auto lock = vars[pos].lock();
+        ASSERT_EQ(pos + 1, LockOrder::thread_state().count);
+        lock_nested(vars, pos + 1);
+    }
+}
+
+TEST(MemSafe, LockOrder) {
+
+    ASSERT_FALSE(LockOrder::enabled());
+    LockOrder::enable();
+    ASSERT_TRUE(LockOrder::enabled());
+    {
+        memsafe::Shared<int, SyncTimedMutex> var_a(1);
+        memsafe::Shared<int, SyncTimedShared> var_b(2);
+        memsafe::Weak<memsafe::Shared<int, SyncTimedShared>> weak_b(var_b);
+
+        {
+            auto lock_a = var_a.lock();
+            auto lock_b = var_b.lock_const();
+            ASSERT_EQ(1, LockOrder::m_graph.size());
+            // The same order does not take the global mutex again
+            auto lock_b2 = weak_b.lock_const();
+            ASSERT_EQ(1, LockOrder::m_graph.size());
+        }
+        ASSERT_EQ(0, LockOrder::thread_state().count);
+
+        {
+            auto lock_b = weak_b.lock();
+            ASSERT_EQ(1, LockOrder::thread_state().count);
+            // The inversion is reported before blocking with the acquisition sites of both orders
+            ASSERT_THROW(var_a.lock(), memsafe_error);
+            try {
+                auto lock_a = var_a.lock();
+                FAIL();
+            } catch (memsafe_error &err) {
+                std::string message(err.what());
+                ASSERT_TRUE(message.find("Lock order inversion") != std::string::npos) << message;
+            }
+            // lock_all reports the site of its caller
+            try {
+                auto all = lock_all(var_a);
+                FAIL();
+            } catch (memsafe_error &err) {
+                std::string message(err.what());
+                ASSERT_TRUE(message.find("memsafe_test.cpp") != std::string::npos) << message;
+                ASSERT_EQ(std::string::npos, message.find("memsafe.h")) << message;
+            }
+            ASSERT_EQ(1, LockOrder::thread_state().count);
+            ASSERT_TRUE(var_a.get()->TryLock(false, std::chrono::milliseconds(0))); // Mutex remained unlocked
+            var_a.get()->UnLock(false);
+        }
+
+        {
+            // The capture without exceptions returns the inversion as an error code
+            auto lock_b = var_b.lock();
+            auto result = var_a.try_lock();
+            ASSERT_FALSE(result);
+#if defined(__cpp_lib_expected)
+            ASSERT_EQ(errc::lock_order, result.error());
+#endif
+            ASSERT_EQ(1, LockOrder::thread_state().count);
+        }
+
+        // The handler for canaries only logs the inversion and the lock is acquired
+        LockOrder::set_handler([](const std::string &) {
+            lock_order_reports++;
+        });
+        {
+            auto lock_b = var_b.lock();
+            auto lock_a = var_a.lock();
+            ASSERT_EQ(1, lock_order_reports);
+            ASSERT_EQ(2, LockOrder::thread_state().count);
+        }
+        LockOrder::set_handler(nullptr);
+        ASSERT_EQ(0, LockOrder::thread_state().count);
+
+    }
+    // Destroyed objects are removed from the graph
+    for (auto &node : LockOrder::m_graph) {
+        ASSERT_TRUE(node.second.empty());
+    }
+    ASSERT_EQ(0, LockOrder::m_edges);
+
+    {
+        // The stack of the held objects is not limited by the inline array
+        std::vector<memsafe::Shared<int, SyncTimedMutex>> vars;
+        for (int i = 0; i < 40; i++) {
+            vars.emplace_back(i);
+        }
+        lock_nested(vars, 0);
+        ASSERT_EQ(0, LockOrder::thread_state().count);
+
+        auto lock_last = vars.back().lock();
+        ASSERT_THROW(vars[30].lock(), memsafe_error);
+    }
+    ASSERT_EQ(0, LockOrder::m_edges);
+
+    // Sampling checks only every N-th nested acquisition
+    LockOrder::clear();
+    LockOrder::enable(2);
+    {
+        memsafe::Shared<int, SyncTimedMutex> var_a(1);
+        memsafe::Shared<int, SyncTimedMutex> var_b(2);
+        auto lock_a = var_a.lock();
+        {
+            auto lock_b = var_b.lock();
+        }
+        ASSERT_EQ(0, LockOrder::m_graph.size());
+        {
+            auto lock_b = var_b.lock();
+        }
+        ASSERT_EQ(1, LockOrder::m_graph.size());
+    }
+
+    LockOrder::disable();
+    LockOrder::clear();
+    ASSERT_FALSE(LockOrder::enabled());
+    {
+        memsafe::Shared<int, SyncTimedMutex> var_a(1);
+        auto lock_a = var_a.lock();
+        ASSERT_EQ(0, LockOrder::thread_state().count);
+    }
+}
+
+TEST(MemSafe, LockAll) {
+
+    memsafe::Shared<int, SyncTimedMutex> var_a(1);
+    memsafe::Shared<std::string, SyncTimedShared> var_b("b");
+    memsafe::Shared<int> var_c(3);
+    memsafe::Weak<memsafe::Shared<int, SyncTimedMutex>> weak_a(var_a);
+
+    {
+        auto [a, b, c] = lock_all(var_a, std::as_const(var_b), var_c);
+        static_assert(std::is_same_v<int, decltype(a)>);
+        static_assert(std::is_same_v<const std::string, decltype(b)>);
+        a = 10;
+        c = 30;
+        ASSERT_EQ("b", b);
+
+        // Exclusive access to a, shared access to b from another thread
+        std::thread other([&]() {
+            ASSERT_THROW(var_a.lock(std::chrono::milliseconds(0)), memsafe_error);
+            ASSERT_NO_THROW(var_b.lock_const(std::chrono::milliseconds(0)));
+            ASSERT_THROW(var_b.lock(std::chrono::milliseconds(0)), memsafe_error);
+        });
+        other.join();
+    }
+    ASSERT_EQ(10, *var_a.lock());
+    ASSERT_EQ(30, *var_c);
+    ASSERT_NO_THROW(var_b.lock(std::chrono::milliseconds(0)));
+
+    {
+        auto all = lock_all(std::chrono::milliseconds(10), weak_a, var_b);
+        all.get<0>()++;
+        all.get<1>() = "bb";
+    }
+    ASSERT_EQ(11, *var_a.lock());
+    ASSERT_EQ("bb", *var_b.lock_const());
+
+    // The timeout is common for the whole capture and all captured objects are released
+    {
+        auto guard_b = var_b.lock();
+        std::thread other([&]() {
+            ASSERT_THROW(lock_all(std::chrono::milliseconds(10), var_a, var_b), memsafe_error);
+            ASSERT_NO_THROW(var_a.lock(std::chrono::milliseconds(0)));
+        });
+        other.join();
+    }
+
+    memsafe::Shared<int, SyncTimedMutex> var_null;
+    ASSERT_THROW(lock_all(var_a, var_null), memsafe_error);
+    ASSERT_NO_THROW(var_a.lock(std::chrono::milliseconds(0)));
+
+    // Opposite argument order in two threads does not deadlock
+    std::thread first([&]() {
+        for (int i = 0; i < 1000; i++) {
+            auto [a, b] = lock_all(var_a, var_b);
+            a++;
+        }
+    });
+    std::thread second([&]() {
+        for (int i = 0; i < 1000; i++) {
+            auto [b, a] = lock_all(var_b, weak_a);
+            a++;
+        }
+    });
+    first.join();
+    second.join();
+    ASSERT_EQ(2011, *var_a.lock());
+
+    // Read only capture of the SyncRcu data reads the published snapshot
+    memsafe::Shared<std::string, SyncRcu> var_rcu("rcu");
+    *var_rcu.lock() = "published";
+    {
+        auto [a, rcu] = lock_all(var_a, std::as_const(var_rcu));
+        static_assert(std::is_same_v<const std::string, decltype(rcu)>);
+        ASSERT_EQ("published", rcu);
+        // The snapshot is pinned without lock
+        ASSERT_NO_THROW(var_rcu.lock(std::chrono::milliseconds(0)));
+        ASSERT_EQ("published", rcu);
+    }
+    {
+        auto [rcu] = lock_all(var_rcu);
+        ASSERT_EQ("published", rcu);
+        rcu = "modified";
+    }
+    ASSERT_EQ("modified", *var_rcu.lock_const());
+    ASSERT_EQ("modified", lock_all(std::as_const(var_rcu)).get<0>());
+
+    // The SyncRcu writer released by the retry does not publish a snapshot
+    std::atomic<bool> held = false;
+    std::atomic<bool> done = false;
+    std::thread holder([&]() {
+        auto lock_a = var_a.lock();
+        held = true;
+        while (!done) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    });
+    while (!held) {
+        std::this_thread::yield();
+    }
+    const auto published = var_rcu.get()->snapshot();
+    ASSERT_THROW(lock_all(std::chrono::milliseconds(10), var_rcu, var_a), memsafe_error);
+    ASSERT_EQ(published, var_rcu.get()->snapshot());
+    done = true;
+    holder.join();
+}
+
+TEST(MemSafe, Upgradable) {
+
+    memsafe::Shared<int, SyncUpgradableShared> var(1);
+    memsafe::Weak<memsafe::Shared<int, SyncUpgradableShared>> weak(var);
+
+    {
+        auto upgradable = var.lock_upgradable();
+        ASSERT_EQ(1, *upgradable);
+
+        // Plain readers coexist with the upgradable owner, but not another upgradable owner or writer
+        std::thread other([&]() {
+            ASSERT_NO_THROW(var.lock_const(std::chrono::milliseconds(0)));
+            ASSERT_THROW(var.lock_upgradable(std::chrono::milliseconds(0)), memsafe_error);
+            ASSERT_THROW(var.lock(std::chrono::milliseconds(0)), memsafe_error);
+        });
+        other.join();
+
+        {
+            // The upgrade waits for plain readers to leave
+            auto reader = var.lock_const();
+            ASSERT_THROW(upgradable.upgrade(std::chrono::milliseconds(10)), memsafe_error);
+        }
+
+        {
+            auto writer = upgradable.upgrade();
+            *writer = 2;
+            // Only one exclusive Locker of the upgrade at a time
+            ASSERT_THROW(upgradable.upgrade(std::chrono::milliseconds(0)), memsafe_error);
+            ASSERT_THROW(upgradable.downgrade(), memsafe_error);
+            std::thread other([&]() {
+                ASSERT_THROW(var.lock_const(std::chrono::milliseconds(0)), memsafe_error);
+            });
+            other.join();
+        }
+        // The destroyed exclusive Locker returned the lock to the upgradable mode
+        ASSERT_EQ(2, *upgradable);
+        std::thread other2([&]() {
+            ASSERT_NO_THROW(var.lock_const(std::chrono::milliseconds(0)));
+            ASSERT_THROW(var.lock_upgradable(std::chrono::milliseconds(0)), memsafe_error);
+        });
+        other2.join();
+
+        // After the downgrade another upgradable owner is admitted
+        upgradable.downgrade();
+        ASSERT_THROW(upgradable.upgrade(), memsafe_error);
+        std::thread other3([&]() {
+            ASSERT_NO_THROW(weak.lock_upgradable(std::chrono::milliseconds(0)));
+            ASSERT_THROW(var.lock(std::chrono::milliseconds(0)), memsafe_error);
+        });
+        other3.join();
+    }
+    ASSERT_NO_THROW(var.lock(std::chrono::milliseconds(0)));
+
+    // Check, then modify without a race window
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; i++) {
+        threads.emplace_back([&]() {
+            for (int j = 0; j < 1000; j++) {
+                auto guard = weak.lock_upgradable();
+                if (*guard % 2 == 0) {
+                    auto writer = guard.upgrade();
+                    *writer += 1;
+                } else {
+                    auto writer = guard.upgrade();
+                    *writer += 3;
+                }
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    ASSERT_EQ(2 + 2 * 4000, *var.lock_const());
+
+    // The upgradable lock and the upgrade go through the lock order, the counters and the trace as the other locks
+    memsafe::Shared<int, SyncUpgradableShared> other_var(0);
+    [[maybe_unused]] const void * object = static_cast<const Sync<int> *> (var.get());
+    LockOrder::clear();
+    LockOrder::enable();
+    {
+        auto upgradable = var.lock_upgradable();
+        auto other_lock = other_var.lock_const();
+        ASSERT_THROW(upgradable.upgrade(), memsafe_error); // Waiting for the readers while holding other_var
+    }
+    LockOrder::disable();
+    LockOrder::clear();
+#ifdef MEMSAFE_LOCK_STATS
+    LockStats::reset();
+#endif
+#ifdef MEMSAFE_LOCK_TRACE
+    LockTrace::enable();
+#endif
+    {
+        auto upgradable = var.lock_upgradable();
+        auto writer = upgradable.upgrade();
+    }
+#ifdef MEMSAFE_LOCK_TRACE
+    LockTrace::disable();
+    std::stringstream trace;
+    LockTrace::write_chrome(trace);
+    const std::string json = trace.str();
+    auto count = [&json](const std::string & str) {
+        size_t result = 0;
+        for (size_t pos = json.find(str); pos != std::string::npos; pos = json.find(str, pos + 1)) {
+            result++;
+        }
+        return result;
+    };
+    ASSERT_EQ(2, count("\"name\":\"hold\"")) << json;
+    ASSERT_EQ(2, count("\"mode\":\"const\"")) << json; // The wait and the hold of the upgradable lock
+    ASSERT_EQ(2, count("\"mode\":\"exclusive\"")) << json;
+#endif
+#ifdef MEMSAFE_LOCK_STATS
+    LockStats::Snapshot snapshot = LockStats::snapshot();
+    auto entry = std::ranges::find(snapshot, object, &LockStats::Entry::object);
+    ASSERT_NE(snapshot.end(), entry);
+    ASSERT_EQ(2, entry->counters.acquisitions);
+    ASSERT_EQ(0, LockStats::lookup(LockStats::table(), object)->depth); // Both released
+#endif
+}
+
+TEST(MemSafe, TryLock) {
+
+    memsafe::Shared<int, SyncTimedShared> var(1);
+    memsafe::Weak<memsafe::Shared<int, SyncTimedShared>> weak(var);
+
+    {
+        auto result = var.try_lock();
+        ASSERT_TRUE(result);
+        **result = 2;
+
+        std::thread other([&]() {
+            auto busy = var.try_lock(std::chrono::milliseconds(0));
+            ASSERT_FALSE(busy);
+#if defined(__cpp_lib_expected)
+            ASSERT_EQ(errc::timeout, busy.error());
+#endif
+            ASSERT_FALSE(weak.try_lock_const(std::chrono::milliseconds(0)));
+        });
+        other.join();
+    }
+    {
+        // RAII release of the lock when the result is destroyed
+        auto result = weak.try_lock_const(std::chrono::milliseconds(0));
+        ASSERT_TRUE(result.has_value());
+        ASSERT_EQ(2, **result);
+        std::thread other([&]() {
+            ASSERT_TRUE(var.try_lock_const(std::chrono::milliseconds(0)));
+            ASSERT_FALSE(var.try_lock(std::chrono::milliseconds(0)));
+        });
+        other.join();
+    }
+    ASSERT_TRUE(var.try_lock(std::chrono::milliseconds(0)));
+
+    memsafe::Shared<int, SyncTimedMutex> var_null;
+    memsafe::Weak<memsafe::Shared<int, SyncTimedMutex>> weak_null(var_null);
+    ASSERT_FALSE(var_null.try_lock());
+    ASSERT_FALSE(weak_null.try_lock_const());
+#if defined(__cpp_lib_expected)
+    ASSERT_EQ(errc::null_pointer, var_null.try_lock().error());
+    ASSERT_EQ(errc::null_pointer, weak_null.try_lock_const().error());
+#endif
+
+    // The errors of the policies without a synchronization object are returned without exceptions
+    memsafe::Shared<int, SyncSingleThread> var_single(4);
+    ASSERT_TRUE(var_single.try_lock());
+    ASSERT_FALSE(var_single.try_lock_const(std::chrono::milliseconds(1)));
+    memsafe::Shared<int, Intrusive<Sync>::Policy> var_intrusive(5);
+    ASSERT_TRUE(var_intrusive.try_lock());
+    ASSERT_FALSE(var_intrusive.try_lock(std::chrono::milliseconds(1)));
+#if defined(__cpp_lib_expected)
+    ASSERT_EQ(errc::unsupported, var_single.try_lock(std::chrono::milliseconds(1)).error());
+    ASSERT_EQ(errc::unsupported, var_intrusive.try_lock_const(std::chrono::milliseconds(1)).error());
+#endif
+    std::thread other([&]() {
+        ASSERT_FALSE(var_single.try_lock());
+        ASSERT_FALSE(var_single.try_lock_const());
+#if defined(__cpp_lib_expected)
+        ASSERT_EQ(errc::wrong_thread, var_single.try_lock().error());
+#endif
+    });
+    other.join();
+
+    memsafe::Shared<int, SyncRcu> var_rcu(3);
+    ASSERT_EQ(3, **var_rcu.try_lock_const(std::chrono::milliseconds(0)));
+    static_assert(std::is_same_v<const int&, decltype(**var_rcu.try_lock_const())>);
+    memsafe::Shared<int, SyncRcu> var_rcu_null;
+    ASSERT_FALSE(var_rcu_null.try_lock_const());
+
+    memsafe::Shared<int> var_sync(4);
+    ASSERT_EQ(4, **var_sync.try_lock());
+}
+
+TEST(MemSafe, WeakExpired) {
+
+    memsafe::Weak<memsafe::Shared<int, SyncTimedMutex>> weak;
+    {
+        memsafe::Shared<int, SyncTimedMutex> var(1);
+        weak = memsafe::Weak<memsafe::Shared<int, SyncTimedMutex>>(var);
+        ASSERT_FALSE(weak.expired());
+
+        // The validity check does not capture the data
+        auto guard = var.lock();
+        std::thread other([&]() {
+            ASSERT_TRUE(weak);
+            ASSERT_THROW(weak.lock(std::chrono::milliseconds(0)), memsafe_error);
+        });
+        other.join();
+    }
+    ASSERT_TRUE(weak.expired());
+    ASSERT_FALSE(weak);
+
+    memsafe::Shared<int, SyncTimedMutex> var(2);
+    memsafe::Weak<memsafe::Shared<int, SyncTimedMutex>> weak2(var);
+    {
+        // The promoted strong reference is owned by the Locker without an extra copy
+        auto guard = weak2.lock();
+        ASSERT_EQ(2, var.use_count());
+        auto result = weak2.try_lock_const(std::chrono::milliseconds(0));
+        ASSERT_FALSE(result);
+        ASSERT_EQ(2, var.use_count());
+    }
+    ASSERT_EQ(1, var.use_count());
+}
+
+struct LoadStat {
+    int count;
+    double sum;
+    std::string name;
+
+    double mean() const {
+        return count ? sum / count : 0;
+    }
+};
+
+TEST(MemSafe, Load) {
+
+    memsafe::Shared<LoadStat, SyncTimedShared> stat(LoadStat{2, 5.0, "stat"});
+    memsafe::Weak<memsafe::Shared<LoadStat, SyncTimedShared>> weak(stat);
+
+    LoadStat copy = stat.load();
+    ASSERT_EQ(2, copy.count);
+    ASSERT_EQ("stat", weak.load().name);
+
+    ASSERT_EQ(2.5, stat.visit([](const LoadStat & value) {
+        return value.mean();
+    }));
+    // The result is returned by value, not as a reference to the unlocked data
+    static_assert(std::is_same_v<std::string, decltype(weak.visit([](const LoadStat & value) -> const std::string & {
+            return value.name;
+        }))>);
+
+    auto [count, sum, mean] = stat.load(&LoadStat::count, &LoadStat::sum, &LoadStat::mean);
+    ASSERT_EQ(2, count);
+    ASSERT_EQ(5.0, sum);
+    ASSERT_EQ(2.5, mean);
+    ASSERT_EQ(std::make_tuple(std::string("stat"), 2), weak.load(&LoadStat::name, &LoadStat::count));
+
+    // One read lock for the whole batch
+    {
+        auto guard = stat.lock();
+        std::thread other([&]() {
+            ASSERT_THROW(stat.load(std::chrono::milliseconds(0)), memsafe_error);
+            ASSERT_THROW(weak.visit([](const LoadStat &) {
+            }, std::chrono::milliseconds(0)), memsafe_error);
+        });
+        other.join();
+    }
+
+    memsafe::Shared<int, SyncAtomic> var_atomic(3);
+    ASSERT_EQ(3, var_atomic.load());
+    ASSERT_EQ(6, var_atomic.visit([](int value) {
+        return value * 2;
+    }));
+
+    struct Point {
+        int x;
+        double y;
+    };
+    memsafe::Shared<Point, SyncSeqLock> var_seq(Point{4, 2.0});
+    ASSERT_EQ(6.0, var_seq.visit([](const Point &value) {
+        return value.x + value.y;
+    }));
+    ASSERT_EQ(std::make_tuple(4, 2.0), var_seq.load(&Point::x, &Point::y));
+
+    memsafe::Shared<LoadStat, SyncRcu> var_rcu(LoadStat{1, 1.0, "rcu"});
+    ASSERT_EQ("rcu", var_rcu.load().name);
+    ASSERT_EQ(std::make_tuple(1), var_rcu.load(&LoadStat::count));
+
+    memsafe::Shared<int> var_sync(7);
+    ASSERT_EQ(7, var_sync.load());
+}
+
+struct CopyCount {
+    static inline size_t copies = 0;
+    static inline size_t moves = 0;
+
+    std::vector<uint8_t> buffer;
+
+    CopyCount(size_t size, uint8_t fill) : buffer(size, fill) {
+    }
+
+    CopyCount(const CopyCount & other) : buffer(other.buffer) {
+        copies++;
+    }
+
+    CopyCount(CopyCount && other) : buffer(std::move(other.buffer)) {
+        moves++;
+    }
+
+    CopyCount & operator=(const CopyCount & other) {
+        buffer = other.buffer;
+        copies++;
+        return *this;
+    }
+
+    CopyCount & operator=(CopyCount && other) {
+        buffer = std::move(other.buffer);
+        moves++;
+        return *this;
+    }
+
+    static void reset() {
+        copies = 0;
+        moves = 0;
+    }
+};
+
+template <template <typename> typename S>
+void CopyCountTest() {
+    CopyCount::reset();
+    auto var = memsafe::Shared<CopyCount, S>::make(1000, 1);
+    ASSERT_EQ(0, CopyCount::copies);
+    ASSERT_EQ(0, CopyCount::moves);
+    ASSERT_EQ(1000, (*var.lock()).buffer.size());
+
+    CopyCount::reset();
+    CopyCount message(2000, 2);
+    const uint8_t * data = message.buffer.data();
+    memsafe::Shared<CopyCount, S> var_move(std::move(message));
+    ASSERT_EQ(0, CopyCount::copies);
+    ASSERT_EQ(1, CopyCount::moves);
+    // The buffer was not allocated again
+    ASSERT_EQ(data, (*var_move.lock()).buffer.data());
+
+    CopyCount::reset();
+    CopyCount message2(3000, 3);
+    data = message2.buffer.data();
+    var_move = std::move(message2);
+    ASSERT_EQ(0, CopyCount::copies);
+    ASSERT_EQ(1, CopyCount::moves);
+    ASSERT_EQ(data, (*var_move.lock()).buffer.data());
+
+    CopyCount::reset();
+    memsafe::Weak<memsafe::Shared<CopyCount, S>> weak(var_move);
+    weak.set(CopyCount(4000, 4));
+    ASSERT_EQ(0, CopyCount::copies);
+    ASSERT_EQ(1, CopyCount::moves);
+    ASSERT_EQ(4000, (*var_move.lock()).buffer.size());
+
+    CopyCount::reset();
+    const CopyCount message3(10, 5);
+    memsafe::Shared<CopyCount, S> var_copy(message3);
+    ASSERT_EQ(1, CopyCount::copies);
+    ASSERT_EQ(0, CopyCount::moves);
+}
+
+TEST(MemSafe, InPlace) {
+
+    CopyCountTest<Sync>();
+    CopyCountTest<SyncTimedMutex>();
+    CopyCountTest<SyncTimedShared>();
+    CopyCountTest<SyncFutexMutex>();
+    CopyCountTest<SyncSingleThread>();
+    CopyCountTest<Padded<SyncTimedMutex>::Policy>();
+
+    auto var = memsafe::Shared<std::string, SyncTimedMutex>::make(5, 'x');
+    ASSERT_EQ("xxxxx", *var.lock());
+    memsafe::Shared<std::pair<int, std::string>, SyncTimedShared> var_pair(std::in_place, 1, "one");
+    ASSERT_EQ("one", var_pair.load().second);
+}
+
+template <typename T>
+struct CountingAllocator {
+    typedef T value_type;
+
+    static inline size_t allocations = 0;
+    static inline size_t deallocations = 0;
+
+    CountingAllocator() = default;
+
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U> &) {
+    }
+
+    T * allocate(size_t n) {
+        CountingAllocator<void>::allocations++;
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T * ptr, size_t n) {
+        CountingAllocator<void>::deallocations++;
+        std::allocator<T>().deallocate(ptr, n);
+    }
+
+    template <typename U>
+    bool operator==(const CountingAllocator<U> &) const {
+        return true;
+    }
+};
+
+TEST(MemSafe, Allocator) {
+
+    {
+        auto var = memsafe::Shared<std::string, SyncTimedMutex>::allocate(CountingAllocator<int>(), 3, 'a');
+        memsafe::Weak<memsafe::Shared<std::string, SyncTimedMutex>> weak(var);
+        // The control block and the data in one allocation
+        ASSERT_EQ(1, CountingAllocator<void>::allocations);
+        ASSERT_EQ("aaa", weak.load());
+    }
+    ASSERT_EQ(1, CountingAllocator<void>::deallocations);
+
+    std::array<std::byte, 4096> buffer;
+    std::pmr::monotonic_buffer_resource arena(buffer.data(), buffer.size(), std::pmr::null_memory_resource());
+    {
+        std::deque<memsafe::Shared<int, SyncFutexMutex>> vars;
+        for (int i = 0; i < 10; i++) {
+            vars.emplace_back(std::allocator_arg, std::pmr::polymorphic_allocator<>(&arena), i);
+        }
+        for (int i = 0; i < 10; i++) {
+            auto * ptr = reinterpret_cast<std::byte *> (vars[i].get());
+            ASSERT_TRUE(ptr >= buffer.data() && ptr < buffer.data() + buffer.size());
+            ASSERT_EQ(i, *vars[i].lock());
+        }
+
+        auto var = memsafe::Shared<int, SyncTimedShared>::allocate(&arena, 5);
+        auto * ptr = reinterpret_cast<std::byte *> (var.get());
+        ASSERT_TRUE(ptr >= buffer.data() && ptr < buffer.data() + buffer.size());
+        ASSERT_EQ(5, var.load());
+    }
+    arena.release();
+}
+
+TEST(MemSafe, LocalShared) {
+
+    static_assert(std::is_base_of_v<LocalShared<SyncSingleThread<int>>, Shared<int, SyncSingleThread>>);
+    static_assert(std::is_base_of_v<LocalWeak<SyncSingleThread<int>>, Weak<Shared<int, SyncSingleThread>>>);
+    static_assert(std::is_base_of_v<std::shared_ptr<SyncTimedMutex<int>>, Shared<int, SyncTimedMutex>>);
+
+    Weak<Shared<std::string, SyncSingleThread>> weak;
+    ASSERT_TRUE(weak.expired());
+    ASSERT_THROW(weak.lock(), memsafe_error);
+    {
+        Shared<std::string, SyncSingleThread> var("local");
+        weak = var.weak();
+        ASSERT_EQ(1, var.use_count());
+        {
+            Shared<std::string, SyncSingleThread> copy(var);
+            ASSERT_EQ(2, var.use_count());
+            auto guard = weak.lock();
+            ASSERT_EQ(3, var.use_count());
+            *guard = "changed";
+        }
+        ASSERT_EQ(1, var.use_count());
+        ASSERT_EQ("changed", weak.load());
+        ASSERT_TRUE(weak);
+    }
+    // The data is destroyed, the control block is still referenced by the weak pointer
+    ASSERT_TRUE(weak.expired());
+    ASSERT_FALSE(weak);
+    ASSERT_THROW(weak.lock(), memsafe_error);
+
+    // Allocator and exception in the constructor of the data
+    CountingAllocator<void>::allocations = 0;
+    CountingAllocator<void>::deallocations = 0;
+    {
+        auto var = Shared<std::vector<int>, SyncSingleThread>::allocate(CountingAllocator<int>(), 3, 7);
+        ASSERT_EQ(1, CountingAllocator<void>::allocations);
+        ASSERT_EQ(7, var.load()[2]);
+        ASSERT_THROW((Shared<std::vector<int>, SyncSingleThread>::allocate(CountingAllocator<int>(), SIZE_MAX / 2)), std::length_error);
+        ASSERT_EQ(2, CountingAllocator<void>::allocations);
+        ASSERT_EQ(1, CountingAllocator<void>::deallocations);
+    }
+    ASSERT_EQ(2, CountingAllocator<void>::deallocations);
+
+    // The thread check of the policy is performed before the reference is copied
+    Shared<int, SyncSingleThread> var_single(1);
+    Weak<Shared<int, SyncSingleThread>> weak_single(var_single);
+    std::thread other([&]() {
+        ASSERT_THROW(var_single.lock(), memsafe_error);
+        // The weak reference is not promoted by the foreign thread
+        ASSERT_THROW(weak_single.lock(), memsafe_error);
+        ASSERT_THROW(weak_single.load(), memsafe_error);
+        ASSERT_THROW(weak_single.visit([](const int & value) {
+            return value;
+        }), memsafe_error);
+        ASSERT_THROW({
+            auto all = lock_all(weak_single);
+        }, memsafe_error);
+        auto result = weak_single.try_lock();
+        ASSERT_FALSE(result);
+        auto result_const = weak_single.try_lock_const();
+        ASSERT_FALSE(result_const);
+#if defined(__cpp_lib_expected)
+        ASSERT_EQ(errc::wrong_thread, result.error());
+        ASSERT_EQ(errc::wrong_thread, result_const.error());
+#endif
+    });
+    other.join();
+    ASSERT_EQ(1, var_single.use_count());
+    ASSERT_EQ(1, *weak_single.lock());
+
+    // The weak reference created after the transfer belongs to the new owner
+    Shared<int, SyncSingleThread> var_moved(2);
+    std::thread owner([&]() {
+        Shared<int, SyncSingleThread> local(std::move(var_moved));
+        local.transfer_to_current_thread();
+        Weak<Shared<int, SyncSingleThread>> weak_local(local);
+        ASSERT_EQ(2, *weak_local.lock());
+    });
+    owner.join();
+}
+
+TEST(MemSafe, Transfer) {
+
+    Shared<std::string, SyncSingleThread> var("stage");
+    std::thread stage1([&]() {
+        ASSERT_THROW(var.lock(), memsafe_error);
+        var.transfer_to_current_thread();
+        *var.lock() += " one";
+    });
+    stage1.join();
+    ASSERT_THROW(var.lock(), memsafe_error);
+
+    std::thread stage2([&]() {
+        var.transfer_to_current_thread();
+        *var.lock() += " two";
+    });
+    stage2.join();
+
+    var.transfer_to_current_thread();
+    ASSERT_EQ("stage one two", *var.lock_const());
+    ASSERT_EQ(1, var.use_count());
+
+    {
+        // A copy left in the previous thread would share the non-atomic reference counter
+        Shared<std::string, SyncSingleThread> copy(var);
+        std::thread other([&]() {
+            ASSERT_THROW(var.transfer_to_current_thread(), memsafe_error);
+        });
+        other.join();
+        Weak<Shared<std::string, SyncSingleThread>> weak(var);
+        copy.reset();
+        ASSERT_THROW(var.transfer_to_current_thread(), memsafe_error);
+    }
+    ASSERT_NO_THROW(var.transfer_to_current_thread());
+
+    // Pipeline of the stages with the variables moved through the queues
+    struct Stage {
+        std::mutex mutex;
+        std::condition_variable condition;
+        std::deque<Shared<std::string, SyncSingleThread>> queue;
+
+        void push(Shared<std::string, SyncSingleThread> && item) {
+            std::lock_guard<std::mutex> guard(mutex);
+            queue.push_back(std::move(item));
+            condition.notify_one();
+        }
+
+        Shared<std::string, SyncSingleThread> pop() {
+            std::unique_lock<std::mutex> guard(mutex);
+            condition.wait(guard, [this]() {
+                return !queue.empty();
+            });
+            Shared<std::string, SyncSingleThread> item(std::move(queue.front()));
+            queue.pop_front();
+            return item;
+        }
+    } first, second;
+
+    std::thread worker([&]() {
+        for (int i = 0; i < 100; i++) {
+            Shared<std::string, SyncSingleThread> item = first.pop();
+            item.transfer_to_current_thread();
+            *item.lock() += " worker";
+            second.push(std::move(item));
+        }
+    });
+    for (int i = 0; i < 100; i++) {
+        first.push(Shared<std::string, SyncSingleThread>(std::to_string(i)));
+    }
+    for (int i = 0; i < 100; i++) {
+        Shared<std::string, SyncSingleThread> item = second.pop();
+        item.transfer_to_current_thread();
+        ASSERT_EQ(std::to_string(i) + " worker", *item.lock_const());
+    }
+    worker.join();
+}
+
+#ifdef MEMSAFE_LOCK_STATS
+
+TEST(MemSafe, LockStats) {
+
+    Shared<int, SyncTimedMutex> var(0);
+    const void * object = static_cast<const Sync<int> *> (var.get());
+    auto find = [object]() {
+        for (auto &entry : LockStats::snapshot()) {
+            if (entry.object == object) {
+                return entry;
+            }
+        }
+        return LockStats::Entry{object, "", 0,
+            {}};
+    };
+
+    LockStats::reset();
+    for (int i = 0; i < 10; i++) {
+        *var.lock() += 1;
+    }
+    {
+        auto guard = var.lock();
+        std::this_thread::sleep_for(10ms);
+        std::thread other([&]() {
+            ASSERT_THROW(var.lock(std::chrono::milliseconds(1)), memsafe_error);
+            ASSERT_FALSE(var.try_lock(std::chrono::milliseconds(1)));
+        });
+        other.join();
+    }
+
+    LockStats::Entry entry = find();
+    ASSERT_EQ(11, entry.counters.acquisitions);
+    ASSERT_EQ(2, entry.counters.timeouts);
+    ASSERT_LE(2'000'000, entry.counters.wait_ns);
+    ASSERT_LE(10'000'000, entry.counters.hold_ns);
+    ASSERT_TRUE(std::string(entry.file).ends_with("memsafe_test.cpp"));
+
+    std::stringstream json;
+    LockStats::write_json(json, {entry});
+    ASSERT_TRUE(json.str().starts_with("[\n{\"object\":\"0x")) << json.str();
+    ASSERT_TRUE(json.str().find("\"acquisitions\":11,\"timeouts\":2,") != std::string::npos) << json.str();
+
+    std::stringstream prometheus;
+    LockStats::write_prometheus(prometheus, {entry});
+    ASSERT_TRUE(prometheus.str().starts_with("# TYPE memsafe_lock_acquisitions_total counter\nmemsafe_lock_acquisitions_total{object=\"0x")) << prometheus.str();
+    ASSERT_TRUE(prometheus.str().find("\"} 11\n# TYPE memsafe_lock_timeouts_total counter\n") != std::string::npos) << prometheus.str();
+
+    LockStats::reset();
+    ASSERT_EQ(0, find().counters.acquisitions);
+    var.lock();
+    ASSERT_EQ(1, find().counters.acquisitions);
+    ASSERT_EQ(0, find().counters.timeouts);
+
+    // The acquisitions by lock_all are counted too with the site of the caller
+    Shared<int, SyncTimedShared> var_shared(0);
+    {
+        auto all = lock_all(var_shared);
+    }
+    LockStats::Snapshot all_snapshot = LockStats::snapshot();
+    auto all_entry = std::ranges::find(all_snapshot, static_cast<const void *> (static_cast<const Sync<int> *> (var_shared.get())), &LockStats::Entry::object);
+    ASSERT_NE(all_snapshot.end(), all_entry);
+    ASSERT_TRUE(std::string(all_entry->file).ends_with("memsafe_test.cpp")) << all_entry->file;
+    {
+        auto all = lock_all(var, std::as_const(var_shared));
+        std::this_thread::sleep_for(1ms);
+    }
+    ASSERT_EQ(2, find().counters.acquisitions);
+    ASSERT_LE(1'000'000, find().counters.hold_ns);
+    {
+        auto guard = var.lock();
+        std::thread other([&]() {
+            ASSERT_THROW(lock_all(std::chrono::milliseconds(1), var, var_shared), memsafe_error);
+        });
+        other.join();
+    }
+    ASSERT_EQ(3, find().counters.acquisitions);
+    ASSERT_EQ(1, find().counters.timeouts);
+
+    // The slots of the destroyed objects are freed and their counters are summed per acquisition site
+    auto destroyed = []() {
+        LockStats::Counters result;
+        for (auto &entry : LockStats::snapshot()) {
+            if (!entry.object && std::string(entry.file).ends_with("memsafe_test.cpp")) {
+                result += entry.counters;
+            }
+        }
+        return result;
+    };
+    auto overflow = []() {
+        for (auto &entry : LockStats::snapshot()) {
+            if (!entry.object && entry.file == std::string_view(LockStats::overflow_site)) {
+                return entry.counters.acquisitions;
+            }
+        }
+        return uint64_t(0);
+    };
+    LockStats::reset();
+    const uint64_t overflow_before = overflow();
+    for (int i = 0; i < 1000; i++) {
+        Shared<int, SyncTimedMutex> temp(i);
+        *temp.lock() += 1;
+    }
+    ASSERT_EQ(1000, destroyed().acquisitions);
+    ASSERT_EQ(overflow_before, overflow());
+    {
+        Shared<int, SyncTimedMutex> temp(0);
+        const void * temp_object = static_cast<const Sync<int> *> (temp.get());
+        std::thread other([&]() {
+            temp.lock();
+        });
+        other.join();
+        temp.lock();
+        LockStats::Snapshot snapshot = LockStats::snapshot();
+        auto entry = std::ranges::find(snapshot, temp_object, &LockStats::Entry::object);
+        ASSERT_NE(snapshot.end(), entry);
+        ASSERT_EQ(2, entry->counters.acquisitions); // From the finished thread and the current one
+    }
+    ASSERT_EQ(1002, destroyed().acquisitions);
+    LockStats::reset();
+    ASSERT_EQ(0, destroyed().acquisitions);
+
+    // The destruction takes the global mutex only for the buckets of the claimed slots
+    {
+        Shared<int, SyncTimedMutex> temp(0);
+        std::atomic<uint32_t> & bucket = LockStats::claimed(static_cast<const Sync<int> *> (temp.get()));
+        const uint32_t claimed = bucket.load();
+        {
+            std::lock_guard<std::mutex> guard(LockStats::m_mutex);
+            Shared<int, SyncTimedMutex> unused(0); // Not acquired - destroyed without the mutex
+        }
+        temp.lock();
+        ASSERT_EQ(claimed + 1, bucket.load());
+        for (int i = 0; i < 2; i++) {
+            std::thread other([&]() {
+                temp.lock();
+            });
+            other.join();
+            ASSERT_EQ(claimed + 2, bucket.load()); // The slot of the current thread and a single claim of the retired object
+        }
+        temp.reset();
+        ASSERT_EQ(claimed, bucket.load());
+    }
+}
+
+#endif
+
+#ifdef MEMSAFE_LOCK_TRACE
+
+TEST(MemSafe, LockTrace) {
+
+    Shared<int, SyncTimedShared> var(0);
+    const std::string object = std::format("{}", static_cast<const void *> (static_cast<const Sync<int> *> (var.get())));
+
+    var.lock(); // Not traced
+    LockTrace::enable();
+    {
+        auto guard = var.lock();
+        std::thread other([&]() {
+            ASSERT_FALSE(var.try_lock_const(std::chrono::milliseconds(1)));
+        });
+        other.join();
+    }
+    {
+        auto reader1 = var.lock_const();
+        auto reader2 = var.lock_const();
+    }
+    LockTrace::disable();
+    var.lock_const();
+
+    std::stringstream trace;
+    LockTrace::write_chrome(trace);
+    std::string json = trace.str();
+    ASSERT_TRUE(json.starts_with("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n{\"name\":\"")) << json;
+    ASSERT_TRUE(json.ends_with("\n]}\n")) << json;
+
+    auto count = [&json](const std::string & str) {
+        size_t result = 0;
+        for (size_t pos = json.find(str); pos != std::string::npos; pos = json.find(str, pos + 1)) {
+            result++;
+        }
+        return result;
+    };
+    ASSERT_EQ(3, count("\"name\":\"wait\""));
+    ASSERT_EQ(3, count("\"name\":\"hold\""));
+    ASSERT_EQ(1, count("\"name\":\"timeout\""));
+    ASSERT_EQ(2, count("\"mode\":\"exclusive\""));
+    ASSERT_EQ(5, count("\"mode\":\"const\""));
+    ASSERT_EQ(7, count(std::format("\"object\":\"{}\"", object)));
+
+    // The written events are removed from the buffers
+    std::stringstream empty;
+    LockTrace::write_chrome(empty);
+    ASSERT_EQ("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n]}\n", empty.str());
+
+    // The lock held while writing the trace is written on release by the next call
+    LockTrace::enable();
+    {
+        auto guard = var.lock();
+        std::stringstream before;
+        LockTrace::write_chrome(before);
+        json = before.str();
+        ASSERT_EQ(1, count("\"name\":\"wait\""));
+        ASSERT_EQ(0, count("\"name\":\"hold\""));
+    }
+    LockTrace::disable();
+    std::stringstream after;
+    LockTrace::write_chrome(after);
+    json = after.str();
+    ASSERT_EQ(0, count("\"name\":\"wait\""));
+    ASSERT_EQ(1, count("\"name\":\"hold\""));
+    ASSERT_EQ(1, count("\"mode\":\"exclusive\""));
+
+    // The slot overwritten by its thread during the copy is skipped
+    LockTrace::ThreadBuffer buffer;
+    buffer.slots[0].sequence = 2;
+    buffer.slots[0].object = &buffer;
+    buffer.slots[1].sequence = 2 * (1 + LockTrace::capacity) + 1; // The owner overwrites the slot after the ring wrapped
+    buffer.slots[2].sequence = 6;
+    buffer.head = 3;
+    std::vector<std::pair<uint32_t, LockTrace::Event>> events;
+    {
+        std::lock_guard<std::mutex> guard(LockTrace::m_mutex);
+        buffer.drain(events);
+    }
+    ASSERT_EQ(2, events.size());
+    ASSERT_EQ(&buffer, events[0].second.object);
+}
+
+#endif
+
+TEST(MemSafe, WaitUntil) {
+
+    Shared<int, SyncTimedMutex> var(0);
+    std::thread consumer([&]() {
+        auto guard = var.wait_until([](const int & value) {
+            return value >= 3;
+        });
+        ASSERT_EQ(3, *guard);
+        *guard = -1;
+        var.notify_all();
+    });
+    for (int i = 0; i < 3; i++) {
+        std::this_thread::sleep_for(1ms);
+        *var.lock() += 1;
+        var.notify_one();
+    }
+    auto done = var.wait_until([](const int & value) {
+        return value < 0;
+    }, 1000ms);
+    ASSERT_EQ(-1, *done);
+    consumer.join();
+
+    // The predicate is already satisfied - no waiting
+    Shared<std::string, SyncTimedShared> str("ready");
+    ASSERT_EQ("ready", *str.wait_until([](const std::string & value) {
+        return !value.empty();
+    }, 0ms));
+
+    // The lock is released on timeout and on exceptions of the predicate
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_THROW(str.wait_until([](const std::string & value) {
+        return value.empty();
+    }, 20ms), memsafe_error);
+    ASSERT_LE(20ms, std::chrono::steady_clock::now() - start);
+    ASSERT_THROW(str.wait_until([](const std::string &) -> bool {
+        throw std::runtime_error("predicate");
+    }), std::runtime_error);
+    std::thread other([&]() {
+        ASSERT_EQ("ready", *str.lock_const(0ms));
+    });
+    other.join();
+
+    // The woken waiter takes the lock again only until the deadline
+    Shared<int, SyncTimedMutex> busy(0);
+    std::chrono::steady_clock::duration waited;
+    std::thread waiter([&]() {
+        const auto start = std::chrono::steady_clock::now();
+        ASSERT_THROW(busy.wait_until([](const int & value) {
+            return value > 0;
+        }, 50ms), memsafe_error);
+        waited = std::chrono::steady_clock::now() - start;
+    });
+    std::this_thread::sleep_for(10ms);
+    {
+        auto guard = busy.lock();
+        busy.notify_all();
+        std::this_thread::sleep_for(300ms);
+    }
+    waiter.join();
+    ASSERT_GT(250ms, waited);
+    ASSERT_TRUE(busy.try_lock(0ms));
+}
+
+/*
+ * Single-threaded executor of coroutines for asynchronous locks
+ */
+class TestExecutor {
+public:
+
+    void post(std::coroutine_handle<> handle) {
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            m_queue.push_back(handle);
+        }
+        m_condition.notify_one();
+    }
+
+    // Resumes the posted coroutines until the condition is met (the timer posts from its own thread)
+    bool run(const std::function<bool() > &done, const std::chrono::milliseconds timeout = 1000ms) {
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (!done()) {
+            std::unique_lock<std::mutex> guard(m_mutex);
+            if (!m_condition.wait_until(guard, deadline, [this]() {
+                    return !m_queue.empty();
+                })) {
+                return false;
+            }
+            std::coroutine_handle<> handle = m_queue.front();
+            m_queue.pop_front();
+            guard.unlock();
+            handle.resume();
+        }
+        return true;
+    }
+
+    struct Yield {
+        TestExecutor & executor;
+
+        bool await_ready() {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle) {
+            executor.post(handle);
+        }
+
+        void await_resume() {
+        }
+    };
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::deque<std::coroutine_handle<>> m_queue;
+};
+
+struct TestTask {
+
+    struct promise_type {
+
+        TestTask get_return_object() {
+            return {};
+        }
+
+        std::suspend_never initial_suspend() noexcept {
+            return {};
+        }
+
+        std::suspend_never final_suspend() noexcept {
+            return {};
+        }
+
+        void return_void() {
+        }
+
+        void unhandled_exception() {
+            std::terminate();
+        }
+    };
+};
+
+TEST(MemSafe, LockAsync) {
+
+    TestExecutor executor;
+    auto var = Shared<std::vector<int>, SyncAsyncMutex>::make();
+    std::vector<std::string> log;
+
+    auto writer = [&](int value) -> TestTask {
+        auto guard = co_await var.lock_async(executor);
+        (*guard).push_back(value);
+        co_await TestExecutor::Yield{executor}; // Other coroutines run while the lock is held
+        (*guard).push_back(value * 10);
+        log.push_back(std::format("writer {}", value));
+    };
+    auto reader = [&]() -> TestTask {
+        auto guard = co_await var.lock_const_async(executor);
+        log.push_back(std::format("reader {}", (*guard).size()));
+    };
+
+#ifdef MEMSAFE_LOCK_STATS
+    auto stats = [object = static_cast<const Sync<std::vector<int>> *> (var.get())]() {
+        for (auto &entry : LockStats::snapshot()) {
+            if (entry.object == object) {
+                return entry.counters;
+            }
+        }
+        return LockStats::Counters{};
+    };
+    LockStats::reset();
+#endif
+
+    writer(1);
+    writer(2);
+    reader();
+    reader();
+    ASSERT_TRUE(log.empty());
+    ASSERT_TRUE(executor.run([&]() {
+        return log.size() == 4;
+    }));
+    ASSERT_EQ(std::vector<std::string>({"writer 1", "writer 2", "reader 4", "reader 4"}), log);
+#ifdef MEMSAFE_LOCK_STATS
+    ASSERT_EQ(4, stats().acquisitions);
+    ASSERT_EQ(0, stats().hold_ns); // Not counted for the asynchronous locks
+#endif
+    ASSERT_EQ(std::vector<int>({1, 10, 2, 20}), *var.lock_const());
+
+    // Without the executor the coroutine is resumed by the thread releasing the lock
+    bool resumed = false;
+    auto clear = [&]() -> TestTask { // The lambda must outlive the suspended coroutine
+        auto guard = co_await var.lock_async();
+        (*guard).clear();
+        resumed = true;
+    };
+    {
+        auto guard = var.lock();
+        clear();
+        ASSERT_FALSE(resumed);
+    }
+    ASSERT_TRUE(resumed);
+    ASSERT_TRUE((*var.lock_const()).empty());
+
+    // Timeout and cancellation resume the coroutine with an exception
+    std::string error;
+    std::stop_source stop;
+    std::thread::id resumed_by;
+    auto waiter = [&](const std::chrono::milliseconds timeout, std::stop_token token) -> TestTask {
+        try {
+            auto guard = co_await var.lock_async(executor, timeout, token);
+            error = "locked";
+        } catch (memsafe_error & ex) {
+            error = ex.what();
+        }
+        resumed_by = std::this_thread::get_id();
+    };
+    {
+        auto guard = var.lock_const();
+        waiter(10ms, {});
+        ASSERT_TRUE(executor.run([&]() {
+            return !error.empty();
+        }));
+        ASSERT_EQ("lock_async timeout", error);
+
+        error.clear();
+        waiter(5000ms, stop.get_token());
+        stop.request_stop();
+        ASSERT_TRUE(executor.run([&]() {
+            return !error.empty();
+        }));
+        ASSERT_EQ("lock_async cancelled", error);
+
+        error.clear();
+        waiter(5000ms, stop.get_token()); // The stop was already requested
+        ASSERT_EQ("lock_async cancelled", error);
+#ifdef MEMSAFE_LOCK_STATS
+        ASSERT_EQ(1, stats().timeouts); // The cancellation is not a timeout
+#endif
+
+        // With the executor the stop requested by another thread is resumed by the executor
+        error.clear();
+        std::stop_source stop_other;
+        waiter(5000ms, stop_other.get_token());
+        std::thread([&]() {
+            stop_other.request_stop();
+        }).join();
+        ASSERT_TRUE(error.empty());
+        ASSERT_TRUE(executor.run([&]() {
+            return !error.empty();
+        }));
+        ASSERT_EQ("lock_async cancelled", error);
+        ASSERT_EQ(std::this_thread::get_id(), resumed_by);
+
+        // Without the executor the coroutine is resumed by the worker thread, neither by the timer thread nor by the thread requesting the stop
+        std::atomic<bool> done = false;
+        auto inline_waiter = [&](const std::chrono::milliseconds timeout, std::stop_token token) -> TestTask {
+            try {
+                auto guard = co_await var.lock_async(timeout, token);
+            } catch (memsafe_error &) {
+            }
+            resumed_by = std::this_thread::get_id();
+            done = true;
+        };
+        inline_waiter(10ms, {});
+        while (!done) {
+            std::this_thread::sleep_for(1ms);
+        }
+        ASSERT_NE(std::this_thread::get_id(), resumed_by);
+        ASSERT_NE(AsyncTimer::instance().m_thread.get_id(), resumed_by);
+        ASSERT_EQ(AsyncResumer::instance().m_thread.get_id(), resumed_by);
+
+        done = false;
+        std::stop_source stop_inline;
+        std::thread::id stopping;
+        inline_waiter(5000ms, stop_inline.get_token());
+        std::thread([&]() {
+            stopping = std::this_thread::get_id();
+            stop_inline.request_stop();
+        }).join();
+        while (!done) {
+            std::this_thread::sleep_for(1ms);
+        }
+        ASSERT_NE(stopping, resumed_by);
+        ASSERT_EQ(AsyncResumer::instance().m_thread.get_id(), resumed_by);
+
+        // Blocking threads wait in the same queue
+        std::thread other([&]() {
+            ASSERT_THROW(var.lock(10ms), memsafe_error);
+            ASSERT_TRUE(var.try_lock_const(10ms));
+        });
+        other.join();
+    }
+
+    // The queued coroutine and the blocked thread are granted in order
+    std::atomic<int> order = 0;
+    int coroutine_order = 0;
+    std::thread other;
+    auto first = [&]() -> TestTask {
+        auto guard = co_await var.lock_async(executor);
+        coroutine_order = ++order;
+    };
+    {
+        auto guard = var.lock();
+        first();
+        other = std::thread([&]() {
+            auto guard = var.lock();
+            ++order;
+        });
+        std::this_thread::sleep_for(10ms);
+    }
+    ASSERT_TRUE(executor.run([&]() {
+        return coroutine_order;
+    }));
+    other.join();
+    ASSERT_EQ(1, coroutine_order);
+    ASSERT_EQ(2, order);
+}
+
+TEST(MemSafe, Executor) {
+
+    Shared<std::vector<int>, SyncExecutor> var(std::vector<int>{});
+    std::thread::id worker = var.submit([](std::vector<int> &) {
+        return std::this_thread::get_id();
+    }).get();
+    ASSERT_NE(std::this_thread::get_id(), worker);
+
+    std::vector<std::thread> threads;
+    for (int thread = 0; thread < 4; thread++) {
+        threads.emplace_back([&, thread]() {
+            std::future<void> last;
+            for (int i = 0; i < 1000; i++) {
+                last = var.submit([&, thread](std::vector<int> & data) {
+                    ASSERT_EQ(worker, std::this_thread::get_id());
+                    data.push_back(thread);
+                });
+            }
+            last.get();
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    ASSERT_EQ(4000, var.submit([](std::vector<int> & data) {
+        return data.size();
+    }).get());
+
+    // The closure submitted by a closure of the same actor is queued after the already submitted ones
+    std::promise<void> blocker;
+    var.submit([future = blocker.get_future().share()](std::vector<int> &) {
+        future.wait();
+    });
+    var.submit([](std::vector<int> & data) {
+        data.push_back(1);
+    });
+    auto nested = var.submit([&](std::vector<int> & data) {
+        data.push_back(-1);
+        return var.submit([](std::vector<int> & data) {
+            data.push_back(3);
+            return data.size();
+        });
+    });
+    var.submit([](std::vector<int> & data) {
+        data.push_back(2);
+    });
+    blocker.set_value();
+    ASSERT_EQ(4004, nested.get().get());
+    ASSERT_EQ(std::vector<int>({1, -1, 2, 3}), var.submit([](std::vector<int> & data) {
+        return std::vector<int>(data.end() - 4, data.end());
+    }).get());
+
+    // A closure can wait for the result of another actor
+    Shared<int, SyncExecutor> other(42);
+    ASSERT_EQ(42, var.submit([&](std::vector<int> &) {
+        return other.submit([](int & value) {
+            return value;
+        }).get();
+    }).get());
+
+    // Exceptions are passed to the future, the worker continues
+    auto error = var.submit([](std::vector<int> &) -> int {
+        throw std::runtime_error("executor");
+    });
+    ASSERT_THROW(error.get(), std::runtime_error);
+    ASSERT_EQ(3, var.submit([](std::vector<int> & data) {
+        return data.back();
+    }).get());
+
+    // The queued closures are executed before the data is destroyed
+    std::atomic<int> executed = 0;
+    {
+        Shared<int, SyncExecutor> counter(0);
+        for (int i = 0; i < 100; i++) {
+            counter.submit([&executed](int & value) {
+                value++;
+                executed++;
+            });
+        }
+    }
+    ASSERT_EQ(100, executed);
+
+    // The closure releasing the last reference to its actor does not join its own worker, the queue is executed first
+    executed = 0;
+    std::promise<void> last_blocker;
+    {
+        Shared<int, SyncExecutor> self(0);
+        self.submit([future = last_blocker.get_future().share()](int &) {
+            future.wait();
+        });
+        self.submit([self, &executed](int &) mutable {
+            executed++;
+            self = Shared<int, SyncExecutor>(); // Not the last reference yet
+        });
+        self.submit([self](int &) {
+        });
+        for (int i = 0; i < 10; i++) {
+            self.submit([&executed](int &) {
+                executed++;
+            });
+        }
+    }
+    last_blocker.set_value();
+    for (int i = 0; i < 1000 && executed != 11; i++) {
+        std::this_thread::sleep_for(1ms);
+    }
+    ASSERT_EQ(11, executed);
+}
+
+template <typename T>
+concept AllocatedFromResource = requires(std::pmr::memory_resource * resource) {
+    T::allocate(resource);
+};
+
+TEST(MemSafe, Intrusive) {
+
+    typedef Shared<std::string, Intrusive<SyncTimedMutex>::Policy> SharedType;
+
+    EXPECT_EQ(8, sizeof (SharedType));
+    EXPECT_EQ(8, sizeof (Weak<SharedType>));
+    EXPECT_EQ(8, sizeof (Locker<std::string, SharedType::SharedType>));
+    EXPECT_EQ(8 + sizeof (SyncTimedMutex<int>), sizeof (IntrusiveBlock<Intrusive<SyncTimedMutex>::Policy<int>>));
+
+    // The block without a deleter is not allocated by an allocator
+    static_assert(!std::is_constructible_v<SharedType, std::allocator_arg_t, std::allocator<int>, const char *>);
+    static_assert(!AllocatedFromResource<SharedType>);
+    static_assert(AllocatedFromResource<Shared<std::string, SyncTimedMutex>>);
+
+    Weak<SharedType> weak;
+    ASSERT_TRUE(weak.expired());
+    {
+        SharedType var("intrusive");
+        weak = var.weak();
+        ASSERT_EQ(1, var.use_count());
+        {
+            SharedType copy(var);
+            auto guard = weak.lock();
+            ASSERT_EQ(3, var.use_count());
+            *guard += "!";
+
+            std::thread other([&]() {
+                ASSERT_THROW(var.lock(std::chrono::milliseconds(0)), memsafe_error);
+            });
+            other.join();
+        }
+        ASSERT_EQ(1, var.use_count());
+        ASSERT_EQ("intrusive!", weak.load());
+    }
+    ASSERT_TRUE(weak.expired());
+    ASSERT_THROW(weak.lock(), memsafe_error);
+
+    // Other policies keep their capabilities
+    Shared<int, Intrusive<SyncTimedShared>::Policy> var_shared(1);
+    auto reader1 = var_shared.lock_const();
+    auto reader2 = var_shared.lock_const();
+    ASSERT_EQ(2, *reader1 + *reader2);
+    auto var_atomic = Shared<int, Intrusive<SyncAtomic>::Policy>::make(5);
+    ASSERT_EQ(5, var_atomic.fetch_add(1));
+    ASSERT_EQ(6, var_atomic.load());
+    Shared<int, Intrusive<SyncRcu>::Policy> var_rcu(7);
+    ASSERT_EQ(7, *var_rcu.lock_const());
+
+    // Promotion of weak references races with the release of the last strong reference
+    for (int i = 0; i < 100; i++) {
+        SharedType * var = new SharedType("race");
+        Weak<SharedType> weak_race(*var);
+        std::thread other([&]() {
+            for (int j = 0; j < 100; j++) {
+                try {
+                    ASSERT_EQ("race", *weak_race.lock());
+                } catch (memsafe_error &) {
+                    ASSERT_TRUE(weak_race.expired());
+                }
+            }
+        });
+        delete var;
+        other.join();
+    }
+}
+
 TEST(MemSafe, Depend) {
     {
         std::vector<int> vect(100000, 0);